@@ -9,275 +9,2503 @@
 #include <algorithm>
 #include <functional>
 #include <iostream>
+#include <iterator>
 #include <sstream>
+#include <utility>
 #include <vector>
 
 #include <stdlib.h>
 
 #include <errno.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <unistd.h>
 #include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+
+#if __cplusplus >= 201100L
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SORTCHECK_X86 1
+#include <immintrin.h>
+#else
+#define SORTCHECK_X86 0
+#endif
+
+// Optional USDT tracepoints (enabled via -DSORTCHECK_USDT,
+// need <sys/sdt.h> from SystemTap)
+#ifdef SORTCHECK_USDT
+#include <sys/sdt.h>
+#define SORTCHECK_PROBE3(name, a1, a2, a3)                                     \
+  DTRACE_PROBE3(sortcheck, name, a1, a2, a3)
+#define SORTCHECK_PROBE5(name, a1, a2, a3, a4, a5)                             \
+  DTRACE_PROBE5(sortcheck, name, a1, a2, a3, a4, a5)
+#else
+#define SORTCHECK_PROBE3(name, a1, a2, a3)
+#define SORTCHECK_PROBE5(name, a1, a2, a3, a4, a5)
+#endif
 
 // Alas, syslog.h defines very popular symbols like LOG_ERROR
 // so we can't include it
 extern "C" void syslog(int __pri, const char *__fmt, ...);
 
-namespace sortcheck {
+namespace sortcheck {
+
+#if __cplusplus >= 201100L
+#define SORTCHECK_NOEXCEPT(expr) noexcept(expr)
+#define SORTCHECK_MOVE(x) std::move(x)
+#else
+#define SORTCHECK_NOEXCEPT(expr)
+#define SORTCHECK_MOVE(x) (x)
+#endif
+
+enum { SORTCHECK_LESS = -1, SORTCHECK_EQUAL = 0, SORTCHECK_GREATER = 1 };
+
+struct Compare {
+  template <typename A, typename B>
+  bool operator()(const A &lhs, const B &rhs) const
+      SORTCHECK_NOEXCEPT(noexcept(lhs < rhs)) {
+    return lhs < rhs;
+  }
+};
+
+// Default number of elements checked by check_range
+// (can be overriden via SORTCHECK_WINDOW)
+#ifndef SORTCHECK_WINDOW
+#define SORTCHECK_WINDOW 32
+#endif
+
+enum WindowMode {
+  WINDOW_PREFIX,  // Check first elements of range
+  WINDOW_CHUNKS,  // Check all consecutive chunks of range
+  WINDOW_STRIDE   // Check elements evenly spread over range
+};
+
+struct Options {
+  bool abort;
+  int verbose;
+  bool syslog;
+  int exit_code;
+  int out;
+  const char *ring;
+  unsigned long checks;
+  unsigned shuffle;
+  size_t window;
+  WindowMode window_mode;
+  double max_overhead;
+  unsigned long fixed_cost;  // Cycles per comparison (for testing)
+  double cpu_budget;
+  bool trace;
+  bool post_check;
+  bool insert_check;
+  unsigned long budget;
+  bool cache;
+  long probes;
+  unsigned async;
+  unsigned threads;
+  bool dedup;
+  const char *report_table;
+  unsigned long max_reports;
+  const char *stats;
+  // SORTCHECK_SAMPLING
+  unsigned long sample_first;
+  unsigned long sample_period;
+  unsigned long sample_max_period;
+};
+
+// SORTCHECK_CHECKS bits
+#define SORTCHECK_CHECK_REFLEXIVITY (1 << 0)
+#define SORTCHECK_CHECK_SYMMETRY (1 << 1)
+#define SORTCHECK_CHECK_TRANSITIVITY (1 << 2)
+#define SORTCHECK_CHECK_SORTED (1 << 3)
+#define SORTCHECK_CHECK_ORDERED (1 << 4)
+
+// One-time initialization of global state which may race between threads
+enum { INIT_NONE = 0, INIT_BUSY, INIT_DONE };
+
+inline bool is_initialized(int &state) {
+  return __builtin_expect(
+      __atomic_load_n(&state, __ATOMIC_ACQUIRE) == INIT_DONE, 1);
+}
+
+// Returns true if caller should initialize object (and then call finish_init);
+// otherwise waits until other thread initializes it.
+inline bool start_init(int &state) {
+  int expected = INIT_NONE;
+  if (__atomic_compare_exchange_n(&state, &expected, INIT_BUSY, false,
+                                  __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+    return true;
+  while (__atomic_load_n(&state, __ATOMIC_ACQUIRE) != INIT_DONE)
+    ;
+  return false;
+}
+
+inline void finish_init(int &state) {
+  __atomic_store_n(&state, INIT_DONE, __ATOMIC_RELEASE);
+}
+
+inline void dump_stats();
+inline void dump_stats_on_signal(int);
+
+inline void parse_options(Options &opts) {
+  const char *verbose = getenv("SORTCHECK_VERBOSE");
+  opts.verbose = verbose ? atoi(verbose) : 0;
+
+  const char *slog = getenv("SORTCHECK_SYSLOG");
+  opts.syslog = slog ? atoi(slog) : 0;
+
+  const char *abrt = getenv("SORTCHECK_ABORT");
+  opts.abort = abrt ? atoi(abrt) : 1;
+
+  const char *exit_code = getenv("SORTCHECK_EXIT_CODE");
+  opts.exit_code = exit_code ? atoi(exit_code) : 1;
+
+  if (const char *checks = getenv("SORTCHECK_CHECKS")) {
+    const bool is_binary =
+        checks && checks[0] == '0' && (checks[1] == 'b' || checks[1] == 'B');
+    opts.checks = strtoul(checks, (char **)0, is_binary ? 2 : 0);
+    if (!opts.checks) {
+      std::cerr << "sortcheck: all checks disabled in SORTCHECK_CHECKS\n";
+    }
+  } else {
+    opts.checks = ~0ul;
+  }
+
+  opts.ring = 0;
+  const char *out = getenv("SORTCHECK_OUTPUT");
+  if (out && strncmp(out, "ring:", 5) == 0) {
+    // Errors are written as binary records (mapped lazily),
+    // other messages go to stdout
+    opts.ring = out + 5;
+    opts.out = STDOUT_FILENO;
+  } else if (out) {
+    opts.out = open(out, O_WRONLY | O_CREAT | O_APPEND, 0777);
+    if (opts.out < 0) {
+      std::cerr << "sortcheck: failed to open " << out << " (errno " << errno
+                << ")\n";
+      abort();
+    }
+  } else {
+    opts.out = STDOUT_FILENO;
+  }
+
+  if (const char *shuffle = getenv("SORTCHECK_SHUFFLE")) {
+    if (strcmp(shuffle, "rand") == 0 || strcmp(shuffle, "random") == 0) {
+      opts.shuffle = rand();
+    } else {
+      opts.shuffle = atoi(shuffle);
+    }
+  } else {
+    opts.shuffle = UINT_MAX;  // Disable
+  }
+
+  const char *window = getenv("SORTCHECK_WINDOW");
+  opts.window = window ? strtoul(window, (char **)0, 0) : SORTCHECK_WINDOW;
+
+  if (const char *mode = getenv("SORTCHECK_WINDOW_MODE")) {
+    if (strcmp(mode, "prefix") == 0) {
+      opts.window_mode = WINDOW_PREFIX;
+    } else if (strcmp(mode, "chunks") == 0) {
+      opts.window_mode = WINDOW_CHUNKS;
+    } else if (strcmp(mode, "stride") == 0) {
+      opts.window_mode = WINDOW_STRIDE;
+    } else {
+      std::cerr << "sortcheck: unknown SORTCHECK_WINDOW_MODE: " << mode
+                << '\n';
+      abort();
+    }
+  } else {
+    opts.window_mode = WINDOW_PREFIX;
+  }
+
+  // Format is N% or fraction
+  if (const char *overhead = getenv("SORTCHECK_MAX_OVERHEAD")) {
+    char *end;
+    opts.max_overhead = strtod(overhead, &end);
+    if (*end == '%') {
+      opts.max_overhead /= 100;
+      ++end;
+    }
+    if (*end || opts.max_overhead < 0) {
+      std::cerr << "sortcheck: invalid SORTCHECK_MAX_OVERHEAD: " << overhead
+                << '\n';
+      abort();
+    }
+  } else {
+    opts.max_overhead = 0;  // Disable
+  }
+
+  // Use fixed costs of comparator and sort instead of measuring them
+  // (makes SORTCHECK_MAX_OVERHEAD reproducible in tests)
+  if (const char *cost = getenv("SORTCHECK_FIXED_COST")) {
+    char *end;
+    opts.fixed_cost = strtoul(cost, &end, 0);
+    if (*end || !opts.fixed_cost) {
+      std::cerr << "sortcheck: invalid SORTCHECK_FIXED_COST: " << cost << '\n';
+      abort();
+    }
+  } else {
+    opts.fixed_cost = 0;
+  }
+
+  if (const char *cpu_budget = getenv("SORTCHECK_CPU_BUDGET")) {
+    char *end;
+    opts.cpu_budget = strtod(cpu_budget, &end);
+    if (*end == '%') {
+      opts.cpu_budget /= 100;
+      ++end;
+    }
+    if (*end || opts.cpu_budget <= 0) {
+      std::cerr << "sortcheck: invalid SORTCHECK_CPU_BUDGET: " << cpu_budget
+                << '\n';
+      abort();
+    }
+  } else {
+    opts.cpu_budget = 0;  // Disable
+  }
+
+  const char *budget = getenv("SORTCHECK_BUDGET");
+  opts.budget = budget ? strtoul(budget, (char **)0, 0) : 0;
+
+  const char *cache = getenv("SORTCHECK_CACHE");
+  opts.cache = cache ? atoi(cache) : 1;
+
+  const char *probes = getenv("SORTCHECK_PROBES");
+  opts.probes = probes ? atol(probes) : -1;
+
+  const char *async = getenv("SORTCHECK_ASYNC");
+  opts.async = async ? atoi(async) : 0;
+
+  const char *threads = getenv("SORTCHECK_THREADS");
+  opts.threads = threads ? atoi(threads) : 1;
+
+  const char *dedup = getenv("SORTCHECK_DEDUP");
+  opts.dedup = dedup ? atoi(dedup) : 0;
+
+  // Shared table implies deduplication
+  opts.report_table = getenv("SORTCHECK_REPORT_TABLE");
+  if (opts.report_table)
+    opts.dedup = true;
+
+  const char *max_reports = getenv("SORTCHECK_MAX_REPORTS");
+  opts.max_reports = max_reports ? strtoul(max_reports, (char **)0, 0) : 0;
+
+  opts.stats = getenv("SORTCHECK_STATS");
+  if (opts.stats) {
+    atexit(dump_stats);
+    if (const char *sig = getenv("SORTCHECK_STATS_SIGNAL")) {
+      struct sigaction sa;
+      memset(&sa, 0, sizeof(sa));
+      sa.sa_handler = dump_stats_on_signal;
+      sa.sa_flags = SA_RESTART;
+      sigaction(atoi(sig), &sa, 0);
+    }
+  }
+
+  const char *trace = getenv("SORTCHECK_TRACE");
+  opts.trace = trace ? atoi(trace) : 0;
+
+  const char *post_check = getenv("SORTCHECK_POST_CHECK");
+  opts.post_check = post_check ? atoi(post_check) : 0;
+
+  const char *insert_check = getenv("SORTCHECK_INSERT_CHECK");
+  opts.insert_check = insert_check ? atoi(insert_check) : 0;
+
+  // Format is N[,K[,M]]
+  if (const char *sampling = getenv("SORTCHECK_SAMPLING")) {
+    char *end;
+    opts.sample_first = strtoul(sampling, &end, 0);
+    opts.sample_period = *end == ',' ? strtoul(end + 1, &end, 0) : 0;
+    opts.sample_max_period =
+        *end == ',' ? strtoul(end + 1, &end, 0) : opts.sample_period;
+    if (*end) {
+      std::cerr << "sortcheck: invalid SORTCHECK_SAMPLING: " << sampling
+                << '\n';
+      abort();
+    }
+  } else {
+    opts.sample_first = ULONG_MAX;
+    opts.sample_period = opts.sample_max_period = 1;
+  }
+}
+
+// Options are parsed once, after that access is a single load
+inline const Options &get_options() {
+  static Options opts;
+  static int state;
+  if (!is_initialized(state) && start_init(state)) {
+    parse_options(opts);
+    finish_init(state);
+  }
+  return opts;
+}
+
+// Static descriptor of instrumented call site.
+// Created via SORTCHECK_SITE macro which SortChecker inserts into
+// instrumented calls.
+struct Site {
+  const char *file;
+  int line;
+  int state;
+  unsigned long calls;
+  unsigned long next_check;
+  unsigned long period;
+  // Statistics (SORTCHECK_STATS)
+  unsigned long checks;
+  unsigned long skipped;  // Due to SORTCHECK_CPU_BUDGET
+  unsigned long elements;
+  unsigned long comparisons;
+  uint64_t cycles;
+  // Costs for SORTCHECK_MAX_OVERHEAD (in COST_SCALE units)
+  unsigned long comparator_cost;
+  unsigned long sort_cost;
+  Site *next;  // All initialized sites are linked in a list
+};
+
+inline Site *&site_list() {
+  static Site *head;
+  return head;
+}
+
+inline void init_site(Site &site, const char *file, int line) {
+  if (start_init(site.state)) {
+    site.file = file;
+    site.line = line;
+    site.next = __atomic_load_n(&site_list(), __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&site_list(), &site.next, &site, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+      ;
+    finish_init(site.state);
+  }
+}
+
+// Each expansion of SORTCHECK_SITE gets its own instantiation
+// (anonymous namespace makes them unique across translation units).
+namespace {
+template <unsigned Id> struct LocalSite {
+  static Site site;
+
+  static Site &get(const char *file, int line) {
+    if (!is_initialized(site.state))
+      init_site(site, file, line);
+    return site;
+  }
+};
+
+template <unsigned Id> Site LocalSite<Id>::site;
+
+// Call sites instrumented by Clang plugin (which can not use __COUNTER__
+// so ids are assigned by plugin and must not clash with LocalSite)
+template <unsigned Id> struct PluginSite {
+  static Site site;
+};
+
+template <unsigned Id> Site PluginSite<Id>::site;
+
+template <unsigned Id> inline Site &plugin_site(const char *file, int line) {
+  Site &site = PluginSite<Id>::site;
+  if (!is_initialized(site.state))
+    init_site(site, file, line);
+  return site;
+}
+} // namespace
+
+#define SORTCHECK_SITE                                                         \
+  sortcheck::LocalSite<__COUNTER__>::get(__FILE__, __LINE__)
+
+// Number of errors reported by current check in this thread
+// (for SORTCHECK_MAX_REPORTS)
+inline unsigned long &reports_in_call() {
+  static __thread unsigned long reports;
+  return reports;
+}
+
+// Decides whether current call at SITE should be sampled
+// according to SORTCHECK_SAMPLING policy: first N calls are always checked,
+// then every K-th call, with period doubling after each check until it
+// reaches M.
+inline bool should_sample(Site &site) {
+  const Options &opts = get_options();
+
+  // Shared counter is contended when hot site is called from many threads
+  // so calls are only counted if they are needed
+  if (opts.sample_first == ULONG_MAX && !opts.stats)
+    return true;
+
+  const unsigned long n = __atomic_fetch_add(&site.calls, 1, __ATOMIC_RELAXED);
+  if (n < opts.sample_first)
+    return true;
+  if (!opts.sample_period)
+    return false;
+
+  unsigned long next = __atomic_load_n(&site.next_check, __ATOMIC_RELAXED);
+  if (n < next)
+    return false;
+
+  unsigned long period = __atomic_load_n(&site.period, __ATOMIC_RELAXED);
+  if (!period)
+    period = opts.sample_period;
+  const unsigned long new_next =
+      n <= ULONG_MAX - period ? n + period : ULONG_MAX;
+  if (!__atomic_compare_exchange_n(&site.next_check, &next, new_next, false,
+                                   __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    return false;  // Some other thread has claimed this check
+
+  if (period < opts.sample_max_period) {
+    period = period <= opts.sample_max_period / 2 ? 2 * period
+                                                  : opts.sample_max_period;
+  }
+  __atomic_store_n(&site.period, period, __ATOMIC_RELAXED);
+
+  return true;
+}
+
+// Per-site statistics (SORTCHECK_STATS): number of checked calls,
+// elements inspected and comparator calls made by checks
+// and time spent in them.
+
+// Timestamp counter on x86, nanoseconds elsewhere
+inline uint64_t read_cycles() {
+#if SORTCHECK_X86
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+// Process-wide token bucket for SORTCHECK_CPU_BUDGET: tokens
+// (nanoseconds of CPU time) accrue at given fraction of CPU time
+// consumed by process, up to CPU_BUDGET_PERIOD worth of them,
+// and are spent by checks (in CPU time of checking thread).
+// Checks are skipped while bucket is empty.
+// Threads take tokens from bucket in batches and spend them locally
+// so that shared bucket is not updated on every check.
+struct CpuBudget {
+  int64_t tokens;
+  uint64_t last;
+};
+
+struct LocalCpuBudget {
+  int64_t tokens;
+  unsigned retry;  // Checks to skip before bucket is tried again
+};
+
+enum {
+  CPU_BUDGET_PERIOD = 1000000000,
+  CPU_BUDGET_BATCH = 1000000,
+  CPU_BUDGET_RETRY = 16
+};
+
+inline uint64_t cpu_time(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+inline CpuBudget &cpu_budget() {
+  static CpuBudget budget;
+  return budget;
+}
+
+inline LocalCpuBudget &local_cpu_budget() {
+  static __thread LocalCpuBudget budget;
+  return budget;
+}
+
+// Refills bucket and takes at most batch tokens from it
+inline int64_t take_cpu_budget() {
+  const Options &opts = get_options();
+  CpuBudget &b = cpu_budget();
+  const int64_t cap = int64_t(opts.cpu_budget * double(CPU_BUDGET_PERIOD));
+  const uint64_t now = cpu_time(CLOCK_PROCESS_CPUTIME_ID);
+  const uint64_t last = __atomic_exchange_n(&b.last, now, __ATOMIC_RELAXED);
+
+  // Bucket is full initially
+  const int64_t refill =
+      !last ? cap : now > last ? int64_t(opts.cpu_budget * (now - last)) : 0;
+  int64_t tokens =
+      __atomic_add_fetch(&b.tokens, std::min(refill, cap), __ATOMIC_RELAXED);
+  while (tokens > cap &&
+         !__atomic_compare_exchange_n(&b.tokens, &tokens, cap, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
+  if (tokens <= 0)
+    return 0;
+
+  // Small buckets are shared by several threads
+  const int64_t batch =
+      std::min(tokens, std::min(int64_t(CPU_BUDGET_BATCH), cap / 16 + 1));
+  __atomic_sub_fetch(&b.tokens, batch, __ATOMIC_RELAXED);
+  return batch;
+}
+
+inline bool has_cpu_budget() {
+  const Options &opts = get_options();
+  if (!opts.cpu_budget)
+    return true;
+
+  LocalCpuBudget &l = local_cpu_budget();
+  if (l.tokens > 0)
+    return true;
+  if (l.retry) {
+    --l.retry;
+    return false;
+  }
+
+  l.tokens = take_cpu_budget();
+  if (l.tokens > 0)
+    return true;
+  l.retry = CPU_BUDGET_RETRY;
+  return false;
+}
+
+// Overspent tokens (and all tokens spent by SORTCHECK_ASYNC workers,
+// which do not take them) are returned to bucket as debt
+inline void spend_cpu_budget(uint64_t ns) {
+  if (!get_options().cpu_budget)
+    return;
+  LocalCpuBudget &l = local_cpu_budget();
+  l.tokens -= int64_t(ns);
+  if (l.tokens < 0) {
+    __atomic_sub_fetch(&cpu_budget().tokens, -l.tokens, __ATOMIC_RELAXED);
+    l.tokens = 0;
+  }
+}
+
+// Decides whether current call at SITE should be checked
+// according to sampling policy and CPU budget
+inline bool should_check(Site &site) {
+  reports_in_call() = 0;
+
+  if (!should_sample(site))
+    return false;
+
+  if (!has_cpu_budget()) {
+    __atomic_fetch_add(&site.skipped, 1, __ATOMIC_RELAXED);
+    return false;
+  }
+
+  __atomic_fetch_add(&site.checks, 1, __ATOMIC_RELAXED);
+  return true;
+}
+
+template <typename Compare> struct CountingCompare {
+  Compare comp;
+  unsigned long &calls;
+  CountingCompare(Compare c, unsigned long &calls_) : comp(c), calls(calls_) {}
+  template <typename A, typename B> bool operator()(const A &a, const B &b) {
+    ++calls;
+    return comp(a, b);
+  }
+};
+
+// Accumulates statistics of single check and adds them to site
+// when check is done. Also fires check__entry and check__return
+// tracepoints (SORTCHECK_USDT).
+class CheckStats {
+  Site &site;
+  const char *const name;
+  CheckStats *const outer;
+  const uint64_t start;
+  const uint64_t cpu_start;  // For SORTCHECK_CPU_BUDGET
+
+  static CheckStats *&current_ref() {
+    static __thread CheckStats *current;
+    return current;
+  }
+
+public:
+  unsigned long elements;
+  unsigned long comparisons;
+
+  CheckStats(Site &site_, const char *name_)
+      : site(site_), name(name_), outer(current_ref()), start(read_cycles()),
+        cpu_start(!outer && get_options().cpu_budget
+                      ? cpu_time(CLOCK_THREAD_CPUTIME_ID)
+                      : 0),
+        elements(0), comparisons(0) {
+    current_ref() = this;
+    SORTCHECK_PROBE3(check__entry, name, site.file, site.line);
+  }
+
+  ~CheckStats() {
+    SORTCHECK_PROBE5(check__return, name, site.file, site.line, elements,
+                     comparisons);
+    current_ref() = outer;
+    const uint64_t cycles = read_cycles() - start;
+    __atomic_fetch_add(&site.elements, elements, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&site.comparisons, comparisons, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&site.cycles, cycles, __ATOMIC_RELAXED);
+    if (!outer && get_options().cpu_budget)
+      spend_cpu_budget(cpu_time(CLOCK_THREAD_CPUTIME_ID) - cpu_start);
+  }
+
+  // Innermost check which runs in this thread (if any)
+  static CheckStats *current() { return current_ref(); }
+
+  // Returns comparator which counts its calls
+  template <typename Compare> CountingCompare<Compare> count(Compare comp) {
+    return CountingCompare<Compare>(comp, comparisons);
+  }
+};
+
+// Buffered writer which is safe to use in signal handlers
+class RawWriter {
+  int fd;
+  size_t len;
+  char buf[4096];
+
+public:
+  explicit RawWriter(int fd_) : fd(fd_), len(0) {}
+
+  ~RawWriter() { flush(); }
+
+  void flush() {
+    if (len && write(fd, buf, len) < 0) {
+      // Nothing we can do here
+    }
+    len = 0;
+  }
+
+  void put(char c) {
+    if (len == sizeof(buf))
+      flush();
+    buf[len++] = c;
+  }
+
+  RawWriter &operator<<(const char *s) {
+    while (*s)
+      put(*s++);
+    return *this;
+  }
+
+  RawWriter &operator<<(unsigned long long x) {
+    char digits[32];
+    size_t n = 0;
+    do {
+      digits[n++] = '0' + x % 10;
+      x /= 10;
+    } while (x);
+    while (n)
+      put(digits[--n]);
+    return *this;
+  }
+
+  // Prints JSON string
+  void quote(const char *s) {
+    put('"');
+    for (; *s; ++s) {
+      if (*s == '"' || *s == '\\')
+        put('\\');
+      put(*s);
+    }
+    put('"');
+  }
+};
+
+// Writes statistics of all sites as JSON
+// (can be called from signal handler)
+inline void dump_stats() {
+  const int fd = open(get_options().stats, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0)
+    return;
+
+  {
+    RawWriter w(fd);
+    w << "{\"clock\": \"" << (SORTCHECK_X86 ? "tsc" : "ns")
+      << "\", \"sites\": [";
+    const char *sep = "\n";
+    for (const Site *site = __atomic_load_n(&site_list(), __ATOMIC_ACQUIRE);
+         site; site = site->next) {
+      w << sep << "  {\"file\": ";
+      w.quote(site->file);
+      w << ", \"line\": " << site->line
+        << ", \"calls\": " << __atomic_load_n(&site->calls, __ATOMIC_RELAXED)
+        << ", \"checks\": " << __atomic_load_n(&site->checks, __ATOMIC_RELAXED)
+        << ", \"skipped\": "
+        << __atomic_load_n(&site->skipped, __ATOMIC_RELAXED)
+        << ", \"elements\": "
+        << __atomic_load_n(&site->elements, __ATOMIC_RELAXED)
+        << ", \"comparisons\": "
+        << __atomic_load_n(&site->comparisons, __ATOMIC_RELAXED)
+        << ", \"cycles\": " << __atomic_load_n(&site->cycles, __ATOMIC_RELAXED)
+        << "}";
+      sep = ",\n";
+    }
+    w << "\n]}\n";
+  }
+
+  close(fd);
+}
+
+inline void dump_stats_on_signal(int) {
+  const int saved_errno = errno;
+  dump_stats();
+  errno = saved_errno;
+}
+
+// Terminates program after reported error if requested
+inline void handle_error(const Options &opts) {
+  if (opts.abort) {
+    close(opts.out);
+    abort();
+  }
+
+  if (opts.exit_code)
+    exit(opts.exit_code);
+}
+
+inline void report_error(const std::string &msg, const Options &opts) {
+  // LOG_ERR==3 from syslog.h conflicts with some packages
+  if (opts.syslog)
+    syslog(3, "%s", msg.c_str());
+
+  // Single write so that reports from different threads do not interleave
+  const std::string line = msg + '\n';
+  if (write(opts.out, line.c_str(), line.size()) >= 0) {
+    fsync(opts.out);
+  } else {
+    std::cerr << "sortcheck: failed to write to " << opts.out << " (errno "
+              << errno << ")\n";
+    abort();
+  }
+
+  handle_error(opts);
+}
+
+enum ErrorKind {
+  ERROR_REFLEXIVE,
+  ERROR_ASYMMETRIC,
+  ERROR_TRANSITIVE,
+  ERROR_EQUIV_TRANSITIVE,
+  ERROR_INCONSISTENT,
+  ERROR_UNSORTED
+};
+
+inline const char *describe_error(int kind) {
+  static const char *const descriptions[] = {
+      "reflexive comparator",   "non-asymmetric comparator",
+      "non-transitive comparator", "non-transitive equivalent comparator",
+      "inconsistent comparator", "unsorted range"};
+  return descriptions[kind];
+}
+
+// FNV-1a
+inline uint64_t hash_bytes(uint64_t h, const void *p, size_t n) {
+  const unsigned char *bytes = static_cast<const unsigned char *>(p);
+  for (size_t i = 0; i < n; ++i)
+    h = (h ^ bytes[i]) * 0x100000001b3ull;
+  return h;
+}
+
+// Lock-free table of reported errors for SORTCHECK_DEDUP,
+// indexed by hash of file, line and kind of error.
+// Table may be shared between processes (SORTCHECK_REPORT_TABLE)
+// so entries do not contain pointers.
+struct ReportEntry {
+  uint64_t key;  // 0 for empty entries
+  uint64_t count;
+  int line;
+  int kind;
+  int ready;  // Set once FILE, LINE and KIND are filled
+  char file[228];  // Truncated if too long
+};
+
+enum { REPORT_TABLE_SIZE = 4096 };
+
+// Layout of SORTCHECK_REPORT_TABLE file: header followed by
+// REPORT_TABLE_SIZE entries
+struct ReportTableHeader {
+  uint64_t magic;
+  uint64_t size;
+};
+
+#define SORTCHECK_REPORT_TABLE_MAGIC 0x3130424154435253ull  // "SRCTAB01"
+
+inline size_t report_table_bytes() {
+  return sizeof(ReportTableHeader) + REPORT_TABLE_SIZE * sizeof(ReportEntry);
+}
+
+// Initializes header of new shared file (which is zero-filled)
+// or checks that header of existing one matches
+inline bool check_shared_header(uint64_t *magic, uint64_t expected_magic,
+                                uint64_t *size, uint64_t expected_size) {
+  uint64_t val = 0;
+  if (!__atomic_compare_exchange_n(magic, &val, expected_magic, false,
+                                   __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+      && val != expected_magic)
+    return false;
+  val = 0;
+  if (!__atomic_compare_exchange_n(size, &val, expected_size, false,
+                                   __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+      && val != expected_size)
+    return false;
+  return true;
+}
+
+// Maps BYTES of FILE shared between processes, creating it if needed
+inline void *map_shared_file(const char *file, size_t bytes) {
+  const int fd = open(file, O_RDWR | O_CREAT, 0666);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    std::cerr << "sortcheck: failed to open " << file << " (errno " << errno
+              << ")\n";
+    abort();
+  }
+
+  if (st.st_size != 0 && size_t(st.st_size) != bytes) {
+    std::cerr << "sortcheck: " << file << " has unexpected size\n";
+    abort();
+  }
+
+  // Concurrent truncations to same size are harmless
+  if (st.st_size == 0 && ftruncate(fd, bytes) < 0) {
+    std::cerr << "sortcheck: failed to resize " << file << " (errno "
+              << errno << ")\n";
+    abort();
+  }
+
+  void *p = mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    std::cerr << "sortcheck: failed to map " << file << " (errno " << errno
+              << ")\n";
+    abort();
+  }
+
+  return p;
+}
+
+inline ReportEntry *map_report_table(const char *file) {
+  ReportTableHeader *hdr = static_cast<ReportTableHeader *>(
+      map_shared_file(file, report_table_bytes()));
+  if (!check_shared_header(&hdr->magic, SORTCHECK_REPORT_TABLE_MAGIC,
+                           &hdr->size, REPORT_TABLE_SIZE)) {
+    std::cerr << "sortcheck: " << file << " is not a report table\n";
+    abort();
+  }
+  return reinterpret_cast<ReportEntry *>(hdr + 1);
+}
+
+inline ReportEntry *get_report_table() {
+  static ReportEntry local_table[REPORT_TABLE_SIZE];
+  static ReportEntry *table;
+  static int state;
+  if (!is_initialized(state) && start_init(state)) {
+    const char *file = get_options().report_table;
+    table = file ? map_report_table(file) : local_table;
+    finish_init(state);
+  }
+  return table;
+}
+
+inline void print_report_summary() {
+  const Options &opts = get_options();
+  const ReportEntry *table = get_report_table();
+  for (size_t i = 0; i < REPORT_TABLE_SIZE; ++i) {
+    const ReportEntry &e = table[i];
+    const uint64_t count = __atomic_load_n(&e.count, __ATOMIC_RELAXED);
+    if (count < 2 || !__atomic_load_n(&e.ready, __ATOMIC_ACQUIRE))
+      continue;
+    std::ostringstream os;
+    os << "sortcheck: summary: " << e.file << ':' << e.line << ": "
+       << describe_error(e.kind) << ": " << count << " times\n";
+    const std::string &msg = os.str();
+    if (write(opts.out, msg.c_str(), msg.size()) < 0)
+      break;
+  }
+}
+
+// Returns number of previous reports of same error at SITE
+inline uint64_t count_report(const Site &site, ErrorKind kind) {
+  uint64_t key = hash_bytes(0xcbf29ce484222325ull, site.file, strlen(site.file));
+  key = hash_bytes(key, &site.line, sizeof(site.line));
+  key = hash_bytes(key, &kind, sizeof(kind));
+  if (!key)
+    key = 1;
+
+  ReportEntry *table = get_report_table();
+  for (size_t i = 0; i < REPORT_TABLE_SIZE; ++i) {
+    ReportEntry &e = table[(key + i) % REPORT_TABLE_SIZE];
+    uint64_t cur = __atomic_load_n(&e.key, __ATOMIC_ACQUIRE);
+    if (!cur && __atomic_compare_exchange_n(&e.key, &cur, key, false,
+                                            __ATOMIC_ACQ_REL,
+                                            __ATOMIC_ACQUIRE)) {
+      strncpy(e.file, site.file, sizeof(e.file) - 1);
+      e.line = site.line;
+      e.kind = kind;
+      __atomic_store_n(&e.ready, 1, __ATOMIC_RELEASE);
+
+      // Shared tables are printed by sortcheck-dump
+      static int summary_registered;
+      if (!get_options().report_table
+          && !__atomic_exchange_n(&summary_registered, 1, __ATOMIC_RELAXED))
+        atexit(print_report_summary);
+
+      cur = key;
+    }
+    if (cur == key)
+      return __atomic_fetch_add(&e.count, 1, __ATOMIC_RELAXED);
+  }
+
+  // Table is full
+  return 0;
+}
+
+// Binary record of SORTCHECK_OUTPUT=ring:path
+// (decoded by sortcheck-decode)
+struct RingRecord {
+  uint64_t seq;  // 1 + index of record, 0 while it's being written
+  uint64_t time;  // CLOCK_REALTIME in nanoseconds
+  uint64_t pos[3];
+  uint32_t tid;
+  int32_t line;
+  int16_t kind;
+  int16_t npos;  // Also has RING_SAMPLED bit
+  char file[76];  // Tail of file name if it's too long
+};
+
+enum { RING_SAMPLED = 0x100 };
+
+// Ring file starts with header followed by RING_SIZE records;
+// oldest records are overwritten
+struct RingHeader {
+  uint64_t magic;
+  uint64_t size;
+  uint64_t head;  // Number of records ever written
+  uint64_t pad;
+};
+
+enum { RING_SIZE = 8192 };
+
+#define SORTCHECK_RING_MAGIC 0x3130474e49524353ull  // "SCRING01"
+
+inline size_t ring_bytes() {
+  return sizeof(RingHeader) + RING_SIZE * sizeof(RingRecord);
+}
+
+inline RingHeader *get_ring() {
+  static RingHeader *ring;
+  static int state;
+  if (!is_initialized(state) && start_init(state)) {
+    const char *file = get_options().ring;
+    ring = static_cast<RingHeader *>(map_shared_file(file, ring_bytes()));
+    if (!check_shared_header(&ring->magic, SORTCHECK_RING_MAGIC, &ring->size,
+                             RING_SIZE)) {
+      std::cerr << "sortcheck: " << file << " is not a ring file\n";
+      abort();
+    }
+    finish_init(state);
+  }
+  return ring;
+}
+
+// Set while positions reported in this thread refer to sequence
+// of sampled elements rather than to checked range or container
+// (see SampledPositions)
+inline bool &sampled_positions() {
+  static __thread bool sampled;
+  return sampled;
+}
+
+class SampledPositions {
+  const bool old;
+
+public:
+  explicit SampledPositions(bool sampled = true) : old(sampled_positions()) {
+    sampled_positions() = sampled;
+  }
+
+  ~SampledPositions() { sampled_positions() = old; }
+};
+
+// Kernel thread ID (cached to avoid syscalls)
+inline uint32_t current_tid() {
+  static __thread uint32_t tid;
+  if (!tid)
+    tid = syscall(SYS_gettid);
+  return tid;
+}
+
+// Appends record to ring with a few stores and no syscalls
+// (clock_gettime is handled in vDSO)
+inline void write_ring_record(const Site &site, ErrorKind kind, size_t n,
+                              const size_t *pos) {
+  RingHeader *ring = get_ring();
+  const uint64_t idx = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+  RingRecord &r = reinterpret_cast<RingRecord *>(ring + 1)[idx % RING_SIZE];
+
+  // Readers skip record until it's complete
+  // (not a fence because TSan does not support them)
+  __atomic_exchange_n(&r.seq, 0, __ATOMIC_ACQ_REL);
+
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  r.time = uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+  for (size_t i = 0; i < 3; ++i)
+    r.pos[i] = i < n ? pos[i] : 0;
+  r.tid = current_tid();
+  r.line = site.line;
+  r.kind = kind;
+  r.npos = n | (sampled_positions() ? RING_SAMPLED : 0);
+  const size_t len = strlen(site.file);
+  const size_t skip = len < sizeof(r.file) ? 0 : len - sizeof(r.file) + 1;
+  memcpy(r.file, site.file + skip, len - skip + 1);
+
+  __atomic_store_n(&r.seq, idx + 1, __ATOMIC_RELEASE);
+}
+
+// Formats report of error of given KIND at positions POS[0], ..., POS[N - 1]
+inline void format_report(std::ostream &os, const char *file, int line,
+                          int kind, size_t n, const uint64_t *pos,
+                          bool sampled) {
+  os << "sortcheck: " << file << ':' << line << ": " << describe_error(kind)
+     << (n > 1 ? " at positions " : " at position ") << pos[0];
+  if (n > 2)
+    os << ", " << pos[1];
+  if (n > 1)
+    os << " and " << pos[n - 1];
+  if (sampled)
+    os << " of sampled elements";
+}
+
+// Reports error of given KIND at positions POS[0], ..., POS[N - 1] (N <= 3)
+// unless it's suppressed by SORTCHECK_DEDUP or SORTCHECK_MAX_REPORTS
+inline void report(Site &site, ErrorKind kind, size_t n, const size_t *pos) {
+  SORTCHECK_PROBE3(error, site.file, site.line, int(kind));
+
+  const Options &opts = get_options();
+  if (opts.dedup && count_report(site, kind))
+    return;
+  if (opts.max_reports && reports_in_call()++ >= opts.max_reports)
+    return;
+
+  if (opts.ring) {
+    write_ring_record(site, kind, n, pos);
+    handle_error(opts);
+    return;
+  }
+
+  const uint64_t pos64[] = {pos[0], n > 1 ? pos[1] : 0, n > 2 ? pos[2] : 0};
+  std::ostringstream os;
+  format_report(os, site.file, site.line, kind, n, pos64,
+                sampled_positions());
+  report_error(os.str(), opts);
+}
+
+inline void report(Site &site, ErrorKind kind, size_t p0) {
+  report(site, kind, 1, &p0);
+}
+
+inline void report(Site &site, ErrorKind kind, size_t p0, size_t p1) {
+  const size_t pos[] = {p0, p1};
+  report(site, kind, 2, pos);
+}
+
+inline void report(Site &site, ErrorKind kind, size_t p0, size_t p1,
+                   size_t p2) {
+  const size_t pos[] = {p0, p1, p2};
+  report(site, kind, 3, pos);
+}
+
+// Per-thread state of SORTCHECK_SHUFFLE generator: each thread gets
+// its own deterministic stream derived from seed
+// (first thread which shuffles uses the seed itself).
+inline unsigned &get_shuffle_seed() {
+  static __thread unsigned seed;
+  static __thread bool seeded;
+  if (!seeded) {
+    static unsigned nthreads;
+    const unsigned id = __atomic_fetch_add(&nthreads, 1, __ATOMIC_RELAXED);
+    seed = get_options().shuffle + id * 2654435761u;
+    seeded = true;
+  }
+  return seed;
+}
+
+// Returns number in [0, n) from SORTCHECK_SHUFFLE generator
+inline size_t shuffle_random(size_t n) {
+  unsigned &seed = get_shuffle_seed();
+  uint64_t r = seed;
+  seed = seed * 1664525u + 1013904223u;
+  r = (r << 32) | seed;
+  seed = seed * 1664525u + 1013904223u;
+  return r % n;
+}
+
+inline size_t mul_mod(size_t a, size_t b, size_t m) {
+#ifdef __SIZEOF_INT128__
+  __extension__ typedef unsigned __int128 uint128_t;
+  return size_t(uint128_t(a) * b % m);
+#else
+  return size_t(uint64_t(a) * b % m);
+#endif
+}
+
+// Pseudo-random permutation of range positions for SORTCHECK_SHUFFLE:
+// position P maps to (P * MUL + ADD) % SIZE, where MUL is coprime
+// with SIZE, so windows see shuffled elements without moving them.
+struct Permutation {
+  size_t size;  // Zero for identity
+  size_t mul, add;
+
+  Permutation() : size(0), mul(1), add(0) {}
+
+  static Permutation random(size_t size) {
+    Permutation p;
+    if (size < 2)
+      return p;
+    p.size = size;
+    do {
+      p.mul = 1 + shuffle_random(size - 1);
+    } while (gcd(p.mul, size) != 1);
+    p.add = shuffle_random(size);
+    return p;
+  }
+
+  static size_t gcd(size_t a, size_t b) {
+    while (b) {
+      const size_t t = a % b;
+      a = b;
+      b = t;
+    }
+    return a;
+  }
+
+  size_t operator()(size_t pos) const {
+    return size ? (mul_mod(pos, mul, size) + add) % size : pos;
+  }
+};
+
+// Simple xorshift64* generator for sampling random elements
+class Random {
+  uint64_t state;
+
+public:
+  explicit Random(uint64_t seed) : state(seed | 1) {}
+
+  uint64_t next() {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545f4914f6cdd1dull;
+  }
+
+  // Returns number in [0, n)
+  size_t below(size_t n) { return next() % n; }
+};
+
+// Seed for randomized checks (counter is thread-local
+// so that checks do not update shared state)
+inline uint64_t next_seed() {
+  static __thread uint64_t checks;
+  return ++checks * 0x9e3779b97f4a7c15ull;
+}
+
+// Bit-packed matrix of comparison results for a window of N elements.
+// Bit J of row I in LESS is set iff comp(x[I], x[J]),
+// in GREATER iff !comp(x[I], x[J]) && comp(x[J], x[I])
+// and in EQUIV iff !comp(x[I], x[J]) && !comp(x[J], x[I])
+// (this matches SORTCHECK_LESS/GREATER/EQUAL in original scalar engine).
+// Transitivity is then checked via row-level ANDNOTs in O(N^3 / 64).
+struct CompareMatrix {
+  size_t n;
+  size_t words;  // Words per row
+  uint64_t *less, *greater, *equiv;
+
+  static size_t words_for(size_t n) { return (n + 63) / 64; }
+
+  // BUF should have room for 3 * N * words_for(N) words
+  CompareMatrix(size_t n_, uint64_t *buf)
+      : n(n_), words(words_for(n_)), less(buf), greater(buf + n * words),
+        equiv(buf + 2 * n * words) {
+    memset(buf, 0, 3 * n * words * sizeof(uint64_t));
+  }
+
+  uint64_t *row(uint64_t *m, size_t i) const { return m + i * words; }
+
+  static bool test(const uint64_t *row, size_t j) {
+    return (row[j / 64] >> (j % 64)) & 1;
+  }
+
+  static void set(uint64_t *row, size_t j) {
+    row[j / 64] |= uint64_t(1) << (j % 64);
+  }
+
+  // Record that comp(x[I], x[J]) is true
+  void set_less(size_t i, size_t j) {
+    set(row(less, i), j);
+    set(row(greater, j), i);  // Transposed LESS until finalize()
+  }
+
+  // Fill row J of transposed LESS in GREATER
+  // (for matrices filled via set() on rows of LESS).
+  void transpose_row(size_t j) {
+    uint64_t *g = row(greater, j);
+    for (size_t i = 0; i < n; ++i) {
+      if (test(row(less, i), j))
+        set(g, i);
+    }
+  }
+
+  // Compute GREATER and EQUIV once all LESS bits are set
+  void finalize() {
+    const uint64_t tail =
+        n % 64 ? (uint64_t(1) << (n % 64)) - 1 : ~uint64_t(0);
+    for (size_t i = 0; i < n; ++i) {
+      uint64_t *l = row(less, i), *g = row(greater, i), *e = row(equiv, i);
+      for (size_t w = 0; w < words; ++w) {
+        const uint64_t lt = l[w], gt = g[w];
+        g[w] = gt & ~lt;
+        e[w] = ~(lt | gt);
+      }
+      e[words - 1] &= tail;
+    }
+  }
+};
+
+// Check whether A & ~B has any bits set
+inline bool any_andnot_scalar(const uint64_t *a, const uint64_t *b,
+                              size_t words) {
+  uint64_t acc = 0;
+  for (size_t w = 0; w < words; ++w)
+    acc |= a[w] & ~b[w];
+  return acc != 0;
+}
+
+#if SORTCHECK_X86
+#ifdef __SSE2__
+inline bool any_andnot_sse2(const uint64_t *a, const uint64_t *b,
+                            size_t words) {
+  const __m128i zero = _mm_setzero_si128();
+  size_t w = 0;
+  for (; w + 2 <= words; w += 2) {
+    const __m128i va = _mm_loadu_si128((const __m128i *)(a + w));
+    const __m128i vb = _mm_loadu_si128((const __m128i *)(b + w));
+    const __m128i x = _mm_andnot_si128(vb, va);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, zero)) != 0xffff)
+      return true;
+  }
+  return any_andnot_scalar(a + w, b + w, words - w);
+}
+#endif
+
+__attribute__((target("avx2"))) inline bool
+any_andnot_avx2(const uint64_t *a, const uint64_t *b, size_t words) {
+  size_t w = 0;
+  for (; w + 4 <= words; w += 4) {
+    const __m256i va = _mm256_loadu_si256((const __m256i *)(a + w));
+    const __m256i vb = _mm256_loadu_si256((const __m256i *)(b + w));
+    // CF is set iff (~vb & va) == 0
+    if (!_mm256_testc_si256(vb, va))
+      return true;
+  }
+  return any_andnot_scalar(a + w, b + w, words - w);
+}
+
+inline bool has_avx2() {
+#ifdef __AVX2__
+  return true;
+#else
+  static int avx2 = -1;
+  int res = __atomic_load_n(&avx2, __ATOMIC_RELAXED);
+  if (res < 0) {
+    __builtin_cpu_init();
+    res = __builtin_cpu_supports("avx2") ? 1 : 0;
+    __atomic_store_n(&avx2, res, __ATOMIC_RELAXED);
+  }
+  return res;
+#endif
+}
+#endif
+
+inline bool any_andnot(const uint64_t *a, const uint64_t *b, size_t words) {
+#if SORTCHECK_X86
+  if (words >= 4 && has_avx2())
+    return any_andnot_avx2(a, b, words);
+#ifdef __SSE2__
+  if (words >= 2)
+    return any_andnot_sse2(a, b, words);
+#endif
+#endif
+  return any_andnot_scalar(a, b, words);
+}
+
+// Parallel checking of large windows (SORTCHECK_THREADS)
+enum { PARALLEL_MIN_WINDOW = 128 };
+
+inline unsigned parallel_threads(size_t n) {
+  return n >= PARALLEL_MIN_WINDOW ? get_options().threads : 1;
+}
+
+#if __cplusplus >= 201100L
+// Runs FN(I) for I in [0, N) in THREADS threads
+template <typename _Fn>
+inline void parallel_for(size_t n, unsigned threads, _Fn fn) {
+  size_t next = 0;
+  auto work = [&]() {
+    for (size_t i; (i = __atomic_fetch_add(&next, 1, __ATOMIC_RELAXED)) < n;)
+      fn(i);
+  };
+  std::vector<std::thread> workers;
+  for (unsigned t = 1; t < threads; ++t)
+    workers.emplace_back(work);
+  work();
+  for (size_t t = 0; t < workers.size(); ++t)
+    workers[t].join();
+}
+#endif
+
+// Per-thread buffer for matrices of large windows, reused across calls
+struct Scratch {
+  uint64_t *data;
+  size_t size;
+  bool busy;
+};
+
+#if __cplusplus >= 201100L
+struct ScratchOwner : Scratch {
+  ~ScratchOwner() { free(data); }
+};
+#endif
+
+inline Scratch &get_scratch() {
+#if __cplusplus >= 201100L
+  static thread_local ScratchOwner scratch;
+#else
+  // Pre-C++11 thread-locals can't have destructors so buffer leaks at thread
+  // exit
+  static __thread Scratch scratch;
+#endif
+  return scratch;
+}
+
+// Grabs memory from per-thread scratch buffer
+// (or from heap if buffer is used by outer check e.g. when comparator
+// itself sorts something).
+class ScratchLease {
+  Scratch *scratch;
+  uint64_t *buf;
+
+  ScratchLease(const ScratchLease &);
+  ScratchLease &operator=(const ScratchLease &);
+
+public:
+  explicit ScratchLease(size_t size) : scratch(0), buf(0) {
+    if (!size)
+      return;
+    scratch = &get_scratch();
+    if (scratch->busy) {
+      scratch = 0;
+      buf = (uint64_t *)malloc(size * sizeof(uint64_t));
+    } else {
+      if (scratch->size < size) {
+        free(scratch->data);
+        scratch->data = (uint64_t *)malloc(size * sizeof(uint64_t));
+        scratch->size = scratch->data ? size : 0;
+      }
+      scratch->busy = true;
+      buf = scratch->data;
+    }
+    if (!buf) {
+      std::cerr << "sortcheck: failed to allocate " << size << " words\n";
+      abort();
+    }
+  }
+
+  ~ScratchLease() {
+    if (scratch)
+      scratch->busy = false;
+    else
+      free(buf);
+  }
+
+  uint64_t *data() const { return buf; }
+};
+
+// Maps window indices to positions in checked range
+struct WindowView {
+  size_t base;
+  size_t stride;
+  Permutation perm;
+
+  explicit WindowView(size_t base_ = 0, size_t stride_ = 1,
+                      const Permutation &perm_ = Permutation())
+      : base(base_), stride(stride_), perm(perm_) {}
+
+  size_t operator()(size_t i) const { return perm(base + i * stride); }
+};
+
+inline bool is_transitive_row(const CompareMatrix &m, size_t i) {
+  uint64_t *const rels[] = {m.less, m.greater, m.equiv};
+  for (size_t j = 0; j < i; ++j) {
+    size_t r = 0;
+    while (!CompareMatrix::test(m.row(rels[r], i), j))
+      ++r;
+    if (any_andnot(m.row(rels[r], j), m.row(rels[r], i), m.words))
+      return false;
+  }
+  return true;
+}
+
+#if __cplusplus >= 201100L
+// Marks rows of large matrix which have transitivity errors
+// (leaves BAD empty if matrix is checked serially)
+inline void find_intransitive_rows(const CompareMatrix &m,
+                                   std::vector<char> &bad) {
+  const unsigned threads = parallel_threads(m.n);
+  if (threads < 2)
+    return;
+  bad.resize(m.n);
+  parallel_for(m.n, threads,
+               [&](size_t i) { bad[i] = !is_transitive_row(m, i); });
+}
+
+// Fills LESS in parallel for large windows
+// (returns false if matrix should be filled serially)
+template <typename _RandomAccessIterator, typename _Index, typename _Compare>
+inline bool fill_matrix_parallel(CompareMatrix &m,
+                                 _RandomAccessIterator __first,
+                                 const _Index &index, _Compare __comp) {
+  const unsigned threads = parallel_threads(m.n);
+  if (threads < 2)
+    return false;
+  parallel_for(m.n, threads, [&](size_t i) {
+    _Compare comp(__comp);
+    uint64_t *row = m.row(m.less, i);
+    for (size_t j = 0; j < m.n; ++j) {
+      if (comp(*(__first + index(i)), *(__first + index(j))))
+        CompareMatrix::set(row, j);
+    }
+  });
+  parallel_for(m.n, threads, [&](size_t j) { m.transpose_row(j); });
+  return true;
+}
+#else
+inline void find_intransitive_rows(const CompareMatrix &,
+                                   std::vector<char> &) {}
+
+template <typename _RandomAccessIterator, typename _Index, typename _Compare>
+inline bool fill_matrix_parallel(CompareMatrix &, _RandomAccessIterator,
+                                 const _Index &, _Compare) {
+  return false;
+}
+#endif
+
+// Positions of randomly sampled elements
+struct SampleView {
+  size_t idx[3];
+
+  size_t operator()(size_t i) const { return idx[i]; }
+};
+
+// Returns true if errors were found
+template <typename _Positions>
+inline bool check_matrix(const CompareMatrix &m, const _Positions &pos,
+                         Site &site) {
+  const Options &opts = get_options();
+  const size_t n = m.n;
+  bool found = false;
+
+  if (opts.checks & SORTCHECK_CHECK_REFLEXIVITY) {
+    for (size_t i = 0; i < n; ++i) {
+      if (CompareMatrix::test(m.row(m.less, i), i)) {
+        report(site, ERROR_REFLEXIVE, pos(i));
+        found = true;
+      }
+    }
+  }
+
+  if (opts.checks & SORTCHECK_CHECK_SYMMETRY) {
+    for (size_t i = 0; i < n; ++i) {
+      const uint64_t *less_i = m.row(m.less, i);
+      for (size_t j = 0; j < i; ++j) {
+        if (CompareMatrix::test(less_i, j) &&
+            CompareMatrix::test(m.row(m.less, j), i)) {
+          report(site, ERROR_ASYMMETRIC, pos(i), pos(j));
+          found = true;
+        }
+      }
+    }
+  }
+
+  if (opts.checks & SORTCHECK_CHECK_TRANSITIVITY) {
+    // Errors are rare so for large windows rows with errors are found
+    // in parallel and only then reported serially
+    std::vector<char> bad_rows;
+    find_intransitive_rows(m, bad_rows);
+
+    uint64_t *const rels[] = {m.less, m.greater, m.equiv};
+    for (size_t i = 0; i < n; ++i) {
+      if (!bad_rows.empty() && !bad_rows[i])
+        continue;
+      for (size_t j = 0; j < i; ++j) {
+        // Find relation between I and J
+        // and check that J ~ K implies I ~ K for same relation
+        size_t r = 0;
+        while (!CompareMatrix::test(m.row(rels[r], i), j))
+          ++r;
+        const uint64_t *row_i = m.row(rels[r], i), *row_j = m.row(rels[r], j);
+        if (!any_andnot(row_j, row_i, m.words))
+          continue;
+        for (size_t w = 0; w < m.words; ++w) {
+          for (uint64_t bad = row_j[w] & ~row_i[w]; bad; bad &= bad - 1) {
+            const size_t k = w * 64 + __builtin_ctzll(bad);
+            report(site,
+                   rels[r] == m.equiv ? ERROR_EQUIV_TRANSITIVE
+                                      : ERROR_TRANSITIVE,
+                   pos(i), pos(j), pos(k));
+            found = true;
+          }
+        }
+      }
+    }
+  }
+
+  return found;
+}
+
+template <bool> struct BoolTag {};
+
+// Checks elements at INDEX(0), ..., INDEX(N - 1) and reports errors
+// at positions POS(0), ..., POS(N - 1)
+template <typename _RandomAccessIterator, typename _Index, typename _Positions,
+          typename _Compare>
+inline bool check_window(_RandomAccessIterator __first, const _Index &index,
+                         const _Positions &pos, size_t n, _Compare __comp,
+                         Site &site) {
+  // Small windows fit on stack
+  uint64_t small_buf[3 * 64];
+  const size_t size = 3 * n * CompareMatrix::words_for(n);
+  ScratchLease scratch(n > 64 ? size : 0);
+
+  CompareMatrix m(n, n > 64 ? scratch.data() : small_buf);
+  if (!fill_matrix_parallel(m, __first, index, __comp)) {
+    for (size_t i = 0; i < n; ++i) {
+      for (size_t j = 0; j < n; ++j) {
+        if (__comp(*(__first + index(i)), *(__first + index(j))))
+          m.set_less(i, j);
+      }
+    }
+  }
+  m.finalize();
+  if (CheckStats *stats = CheckStats::current())
+    stats->comparisons += n * n;
+  else
+    __atomic_fetch_add(&site.comparisons, n * n, __ATOMIC_RELAXED);
+
+  return check_matrix(m, pos, site);
+}
+
+template <typename _RandomAccessIterator, typename _Positions,
+          typename _Compare>
+inline bool check_window(_RandomAccessIterator __first, const _Positions &pos,
+                         size_t n, _Compare __comp, Site &site) {
+  return check_window(__first, pos, pos, n, __comp, site);
+}
+
+template <typename Compare> struct ComparePointers {
+  Compare comp;
+  ComparePointers(Compare c) : comp(c) {}
+  template <typename A, typename B> bool operator()(A *a, B *b) {
+    return comp(*a, *b);
+  }
+};
+
+#if __cplusplus >= 201100L
+// Asynchronous checking (SORTCHECK_ASYNC): copies of windows
+// are checked by background workers.
+
+struct AsyncJob {
+  virtual ~AsyncJob() {}
+  virtual void run() = 0;
+};
+
+class AsyncPool {
+  std::mutex mutex;
+  std::condition_variable has_jobs;
+  std::deque<AsyncJob *> jobs;
+  bool stopped;
+  std::vector<std::thread> workers;
+
+  // Jobs which do not fit are checked synchronously
+  enum { MAX_JOBS = 1024 };
+
+  static bool &is_worker() {
+    static thread_local bool worker;
+    return worker;
+  }
+
+  void work() {
+    is_worker() = true;
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+      has_jobs.wait(lock, [this] { return stopped || !jobs.empty(); });
+      if (jobs.empty())
+        return;  // Stopped and drained
+      AsyncJob *job = jobs.front();
+      jobs.pop_front();
+      lock.unlock();
+      job->run();
+      delete job;
+      lock.lock();
+    }
+  }
+
+public:
+  explicit AsyncPool(unsigned n) : stopped(false) {
+    for (unsigned i = 0; i < n; ++i)
+      workers.emplace_back(&AsyncPool::work, this);
+  }
+
+  // Returns false if job should be run synchronously
+  bool submit(AsyncJob *job) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (stopped || jobs.size() >= MAX_JOBS)
+        return false;
+      jobs.push_back(job);
+    }
+    has_jobs.notify_one();
+    return true;
+  }
+
+  // Waits for pending jobs and stops workers
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopped = true;
+    }
+    has_jobs.notify_all();
+    // Worker may call exit() on error (SORTCHECK_EXIT_CODE)
+    if (is_worker())
+      return;
+    for (size_t i = 0; i < workers.size(); ++i)
+      workers[i].join();
+  }
+};
+
+inline AsyncPool *&async_pool() {
+  static AsyncPool *pool;
+  return pool;
+}
+
+inline void stop_async_pool() { async_pool()->stop(); }
+
+// Returns null if asynchronous checking is disabled
+inline AsyncPool *get_async_pool() {
+  static int state;
+  if (!is_initialized(state) && start_init(state)) {
+    if (unsigned n = get_options().async) {
+      // Pool is never destroyed as workers may outlive static destructors
+      async_pool() = new AsyncPool(n);
+      atexit(stop_async_pool);
+    }
+    finish_init(state);
+  }
+  return async_pool();
+}
+
+// How elements of range are copied for asynchronous checking
+template <typename _Iterator, typename _Compare> struct Snapshot {
+  typedef typename std::iterator_traits<_Iterator>::value_type value_type;
+  typedef _Compare compare_type;
+  static value_type get(_Iterator it) { return *it; }
+  static compare_type comp(_Compare c) { return c; }
+};
+
+// Pointers to container keys are dereferenced
+// as container may be gone by the time of check
+template <typename _Iterator, typename _Compare>
+struct Snapshot<_Iterator, ComparePointers<_Compare> > {
+  typedef typename std::remove_cv<typename std::remove_pointer<
+      typename std::iterator_traits<_Iterator>::value_type>::type>::type
+      value_type;
+  typedef _Compare compare_type;
+  static value_type get(_Iterator it) { return **it; }
+  static compare_type comp(ComparePointers<_Compare> c) { return c.comp; }
+};
+
+template <typename _Tp, typename _Compare> struct WindowJob : AsyncJob {
+  std::vector<_Tp> elems;
+  WindowView pos;
+  _Compare comp;
+  Site *site;
+  bool sampled;
+
+  WindowJob(const WindowView &pos_, _Compare comp_, Site *site_)
+      : pos(pos_), comp(comp_), site(site_), sampled(sampled_positions()) {}
+
+  void run() {
+    // Limit of reports applies to each job separately
+    reports_in_call() = 0;
+    SampledPositions guard(sampled);
+    CheckStats stats(*site, "check_window");
+    check_window(elems.begin(), WindowView(), pos, elems.size(), comp, *site);
+  }
+};
+
+template <typename _RandomAccessIterator, typename _Compare>
+inline bool submit_window(_RandomAccessIterator, const WindowView &, size_t,
+                          _Compare, Site &, BoolTag<false>) {
+  return false;
+}
+
+template <typename _RandomAccessIterator, typename _Compare>
+inline bool submit_window(_RandomAccessIterator __first, const WindowView &pos,
+                          size_t n, _Compare __comp, Site &site,
+                          BoolTag<true>) {
+  AsyncPool *pool = get_async_pool();
+  if (!pool)
+    return false;
+
+  typedef Snapshot<_RandomAccessIterator, _Compare> S;
+  typedef WindowJob<typename S::value_type, typename S::compare_type> Job;
+  Job *job = new Job(pos, S::comp(__comp), &site);
+  job->elems.reserve(n);
+  for (size_t i = 0; i < n; ++i)
+    job->elems.push_back(S::get(__first + pos(i)));
+
+  if (pool->submit(job))
+    return true;
+  delete job;
+  return false;
+}
+
+// Returns true if window was queued for asynchronous checking
+template <typename _RandomAccessIterator, typename _Compare>
+inline bool submit_window(_RandomAccessIterator __first, const WindowView &pos,
+                          size_t n, _Compare __comp, Site &site) {
+  typedef Snapshot<_RandomAccessIterator, _Compare> S;
+  return submit_window(
+      __first, pos, n, __comp, site,
+      BoolTag<std::is_copy_constructible<typename S::value_type>::value &&
+              std::is_copy_constructible<typename S::compare_type>::value>());
+}
+#else
+template <typename _RandomAccessIterator, typename _Compare>
+inline bool submit_window(_RandomAccessIterator, const WindowView &, size_t,
+                          _Compare, Site &) {
+  return false;
+}
+#endif
+
+// Checks window synchronously or queues it for asynchronous checking
+// (returns true if errors were found)
+template <typename _RandomAccessIterator, typename _Compare>
+inline bool check_window(_RandomAccessIterator __first, const WindowView &pos,
+                         size_t n, _Compare __comp, Site &site, bool async) {
+  if (async && n && submit_window(__first, pos, n, __comp, site))
+    return false;
+  return check_window(__first, pos, n, __comp, site);
+}
+
+// Checks random triples of elements (or pairs for short ranges)
+// until BUDGET comparator calls are spent or error is found
+// (returns true in latter case).
+template <typename _RandomAccessIterator, typename _Compare>
+inline bool check_random(_RandomAccessIterator __first, size_t size,
+                         unsigned long budget, _Compare __comp, Site &site) {
+  const size_t n = std::min(size, size_t(3));
+  if (n < 2)
+    return false;
+
+  Random rng(next_seed() + size);
+  for (; budget >= n * n; budget -= n * n) {
+    SampleView pos;
+    for (size_t i = 0; i < n; ++i) {
+      // Pick distinct elements
+      bool dup;
+      do {
+        pos.idx[i] = rng.below(size);
+        dup = false;
+        for (size_t j = 0; j < i; ++j)
+          dup |= pos.idx[j] == pos.idx[i];
+      } while (dup);
+    }
+    if (check_window(__first, pos, n, __comp, site))
+      return true;
+  }
+  return false;
+}
+
+// Returns true if errors were found
+template <typename _RandomAccessIterator, typename _Compare>
+inline bool check_range(_RandomAccessIterator __first,
+                        _RandomAccessIterator __last, _Compare __comp,
+                        Site &site, bool async, size_t window) {
+  const Options &opts = get_options();
+  const size_t size = __last - __first;
+  bool found = false;
+
+  // Comparator calls are counted in check_window
+  CheckStats stats(site, "check_range");
+  stats.elements = size;
+
+  // Windows are taken from shuffled range if requested
+  const Permutation perm = opts.shuffle != UINT_MAX && window
+                               ? Permutation::random(size)
+                               : Permutation();
+
+  // Empty prefix window is a no-op
+  switch (window ? opts.window_mode : WINDOW_PREFIX) {
+  case WINDOW_PREFIX:
+    found = check_window(__first, WindowView(0, 1, perm),
+                         std::min(size, window), __comp, site, async);
+    break;
+  case WINDOW_CHUNKS:
+    for (size_t base = 0; base < size; base += window) {
+      found |= check_window(__first, WindowView(base, 1, perm),
+                            std::min(size - base, window), __comp, site, async);
+    }
+    break;
+  case WINDOW_STRIDE: {
+    const size_t stride = std::max(size / window, size_t(1));
+    found = check_window(__first, WindowView(0, stride, perm),
+                         std::min((size + stride - 1) / stride, window), __comp,
+                         site, async);
+    break;
+  }
+  }
+
+  if (opts.budget)
+    found |= check_random(__first, size, opts.budget, __comp, site);
+  return found;
+}
+
+template <typename _RandomAccessIterator, typename _Compare>
+inline bool check_range(_RandomAccessIterator __first,
+                        _RandomAccessIterator __last, _Compare __comp,
+                        Site &site, bool async = false) {
+  return check_range(__first, __last, __comp, site, async,
+                     get_options().window);
+}
 
-#if __cplusplus >= 201100L
-#define SORTCHECK_NOEXCEPT(expr) noexcept(expr)
-#else
-#define SORTCHECK_NOEXCEPT(expr)
-#endif
+// Adaptive window (SORTCHECK_MAX_OVERHEAD): window of sort site is chosen
+// so that predicted cost of check_range stays below given fraction
+// of sort time. Cost of comparator is measured once per site
+// and cost of sort is measured after each checked sort.
+// Costs are in read_cycles() units multiplied by COST_SCALE.
 
-enum { SORTCHECK_LESS = -1, SORTCHECK_EQUAL = 0, SORTCHECK_GREATER = 1 };
+enum { COST_SCALE = 16, COST_SAMPLES = 16, MAX_ADAPTIVE_WINDOW = 1024 };
 
-struct Compare {
-  template <typename A, typename B>
-  bool operator()(const A &lhs, const B &rhs) const
-      SORTCHECK_NOEXCEPT(noexcept(lhs < rhs)) {
-    return lhs < rhs;
+// Returns N * log2(N) i.e. expected number of comparisons in sort
+inline double sort_units(size_t n) {
+  double units = 0;
+  for (size_t m = n; m > 1; m /= 2)
+    units += n;
+  return units;
+}
+
+template <typename _RandomAccessIterator, typename _Compare>
+inline unsigned long comparator_cost(_RandomAccessIterator __first, size_t n,
+                                     _Compare __comp, Site &site) {
+  if (const unsigned long fixed_cost = get_options().fixed_cost)
+    return fixed_cost * COST_SCALE;
+
+  unsigned long cost = __atomic_load_n(&site.comparator_cost, __ATOMIC_RELAXED);
+  if (cost)
+    return cost;
+
+  const size_t samples = std::min(n - 1, size_t(COST_SAMPLES));
+  bool res = false;
+  const uint64_t start = read_cycles();
+  for (size_t i = 0; i < samples; ++i)
+    res ^= __comp(*(__first + i), *(__first + i + 1));
+  // Use result so that calls are not optimized out
+  __asm__ __volatile__("" : : "r"(res));
+  cost = (read_cycles() - start) * COST_SCALE / samples;
+
+  cost = std::max(cost, 1ul);
+  __atomic_store_n(&site.comparator_cost, cost, __ATOMIC_RELAXED);
+  return cost;
+}
+
+// Predicted cost of check_range with window W:
+// W^2 comparator calls and ~W^3 / 64 bitmask operations per window
+inline double window_cost(size_t w, size_t n, double comparator_cost,
+                          WindowMode mode) {
+  const double wd = w;
+  const double cost = wd * wd * comparator_cost + wd * wd * wd / 64;
+  return mode == WINDOW_CHUNKS ? cost * ((n + w - 1) / w) : cost;
+}
+
+// Returns window for check_range in sort at SITE
+template <typename _RandomAccessIterator, typename _Compare>
+inline size_t choose_window(_RandomAccessIterator __first,
+                            _RandomAccessIterator __last, _Compare __comp,
+                            Site &site) {
+  const Options &opts = get_options();
+  const size_t n = __last - __first;
+  if (!opts.max_overhead || n < 2)
+    return opts.window;
+
+  const double scale = COST_SCALE;
+  const double comp_cost = comparator_cost(__first, n, __comp, site) / scale;
+
+  // Until first sort is measured assume that it's dominated by comparisons
+  const unsigned long sort_cost =
+      __atomic_load_n(&site.sort_cost, __ATOMIC_RELAXED);
+  const double budget = opts.max_overhead * sort_units(n) *
+                        (sort_cost ? sort_cost / scale : comp_cost);
+
+  // Find largest window which fits budget
+  size_t lo = 0, hi = std::min(n, size_t(MAX_ADAPTIVE_WINDOW));
+  while (lo < hi) {
+    const size_t mid = lo + (hi - lo + 1) / 2;
+    if (window_cost(mid, n, comp_cost, opts.window_mode) <= budget)
+      lo = mid;
+    else
+      hi = mid - 1;
   }
-};
+  return lo;
+}
 
-struct Options {
-  bool abort;
-  int verbose;
-  bool syslog;
-  int exit_code;
-  int out;
-  unsigned long checks;
-  unsigned shuffle;
+// Records that sort of N elements at SITE took CYCLES
+inline void update_sort_cost(Site &site, size_t n, uint64_t cycles) {
+  // With fixed cost sorts are assumed to be dominated by comparisons
+  const Options &opts = get_options();
+  if (!opts.max_overhead || opts.fixed_cost || n < 2)
+    return;
+  unsigned long cost =
+      std::max((unsigned long)(cycles * COST_SCALE / sort_units(n)), 1ul);
+  // Smooth out noise
+  if (unsigned long old = __atomic_load_n(&site.sort_cost, __ATOMIC_RELAXED))
+    cost = (old + cost) / 2;
+  __atomic_store_n(&site.sort_cost, cost, __ATOMIC_RELAXED);
+}
+
+// Tracing mode (SORTCHECK_TRACE): instead of checking comparator
+// beforehand with full window, record comparisons made by std::sort itself
+// and verify them against its result (for valid comparator comp(x, y)
+// implies that x is placed before y). Only small window is checked
+// beforehand to catch most blatant errors (e.g. reflexivity).
+
+// Comparison made during traced sort
+// (TRACE_LESS bit in RHS is set if comp(LHS, RHS) returned true).
+struct TraceEntry {
+  uint32_t lhs, rhs;
 };
 
-// SORTCHECK_CHECKS bits
-#define SORTCHECK_CHECK_REFLEXIVITY (1 << 0)
-#define SORTCHECK_CHECK_SYMMETRY (1 << 1)
-#define SORTCHECK_CHECK_TRANSITIVITY (1 << 2)
-#define SORTCHECK_CHECK_SORTED (1 << 3)
-#define SORTCHECK_CHECK_ORDERED (1 << 4)
+// Larger ranges fall back to window checks so that memory used for copy
+// of range and log of comparisons is bounded (log of introsort
+// of TRACE_MAX_ELEMENTS elements fits in TRACE_MAX_ENTRIES).
+enum {
+  TRACE_LESS = 1u << 31,
+  TRACE_MAX_ELEMENTS = 1 << 16,
+  TRACE_MAX_ENTRIES = 1 << 22,
+  TRACE_WINDOW = 8
+};
 
-inline const Options &get_options() {
-  static Options opts;
-  static bool opts_initialized;
-  if (!opts_initialized) {
-    const char *verbose = getenv("SORTCHECK_VERBOSE");
-    opts.verbose = verbose ? atoi(verbose) : 0;
-
-    const char *slog = getenv("SORTCHECK_SYSLOG");
-    opts.syslog = slog ? atoi(slog) : 0;
-
-    const char *abrt = getenv("SORTCHECK_ABORT");
-    opts.abort = abrt ? atoi(abrt) : 1;
-
-    const char *exit_code = getenv("SORTCHECK_EXIT_CODE");
-    opts.exit_code = exit_code ? atoi(exit_code) : 1;
-
-    if (const char *checks = getenv("SORTCHECK_CHECKS")) {
-      const bool is_binary =
-          checks && checks[0] == '0' && (checks[1] == 'b' || checks[1] == 'B');
-      opts.checks = strtoul(checks, (char **)0, is_binary ? 2 : 0);
-      if (!opts.checks) {
-        std::cerr << "sortcheck: all checks disabled in SORTCHECK_CHECKS\n";
-      }
-    } else {
-      opts.checks = ~0ul;
+// Sorts indices of elements and logs comparisons.
+// Broken comparator makes unguarded loops of std::sort run out
+// of sorted range so indices are surrounded by sentinels (index N)
+// which compare false with everything and stop such loops.
+template <typename _RandomAccessIterator, typename _Compare>
+struct TracingCompare {
+  _RandomAccessIterator first;
+  uint32_t n;
+  _Compare comp;
+  std::vector<TraceEntry> *log;
+
+  TracingCompare(_RandomAccessIterator first_, uint32_t n_, _Compare comp_,
+                 std::vector<TraceEntry> *log_)
+      : first(first_), n(n_), comp(comp_), log(log_) {}
+
+  bool operator()(uint32_t lhs, uint32_t rhs) {
+    if (lhs >= n || rhs >= n)
+      return false;
+    const bool less = comp(*(first + lhs), *(first + rhs));
+    if (log->size() < log->capacity()) {
+      const TraceEntry e = {lhs, less ? rhs | TRACE_LESS : rhs};
+      log->push_back(e);
     }
+    return less;
+  }
+};
 
-    if (const char *out = getenv("SORTCHECK_OUTPUT")) {
-      opts.out = open(out, O_WRONLY | O_CREAT | O_APPEND, 0777);
-      if (opts.out < 0) {
-        std::cerr << "sortcheck: failed to open " << out << " (errno " << errno
-                  << ")\n";
-        abort();
+inline void check_trace(const std::vector<TraceEntry> &log,
+                        const std::vector<uint32_t> &perm, Site &site) {
+  CheckStats stats(site, "check_trace");
+  const Options &opts = get_options();
+  const uint32_t n = perm.size();
+  stats.elements = n;
+
+  // Final positions of elements
+  std::vector<uint32_t> rank(n);
+  for (uint32_t i = 0; i < n; ++i)
+    rank[perm[i]] = i;
+
+  // Check that comp(x, y) implies that x is placed before y.
+  // Also for each position P compute minimal rank of y such that
+  // comp(x, y) and rank(x) >= P.
+  std::vector<uint32_t> min_greater(n + 1, n);
+  for (size_t i = 0; i < log.size(); ++i) {
+    if (!(log[i].rhs & TRACE_LESS))
+      continue;
+    const uint32_t lhs = log[i].lhs, rhs = log[i].rhs & ~TRACE_LESS;
+    if (lhs == rhs) {
+      if (opts.checks & SORTCHECK_CHECK_REFLEXIVITY) {
+        report(site, ERROR_REFLEXIVE, lhs);
       }
-    } else {
-      opts.out = STDOUT_FILENO;
-    }
-
-    if (const char *shuffle = getenv("SORTCHECK_SHUFFLE")) {
-      if (strcmp(shuffle, "rand") == 0 || strcmp(shuffle, "random") == 0) {
-        opts.shuffle = rand();
-      } else {
-        opts.shuffle = atoi(shuffle);
+    } else if (rank[lhs] > rank[rhs]) {
+      if (opts.checks & SORTCHECK_CHECK_TRANSITIVITY) {
+        report(site, ERROR_INCONSISTENT, lhs, rhs);
       }
     } else {
-      opts.shuffle = UINT_MAX;  // Disable
+      min_greater[rank[lhs]] = std::min(min_greater[rank[lhs]], rank[rhs]);
     }
-
-    opts_initialized = true;
   }
-  return opts;
-}
-
-inline void report_error(const std::string &msg, const Options &opts) {
-  // LOG_ERR==3 from syslog.h conflicts with some packages
-  if (opts.syslog)
-    syslog(3, "%s", msg.c_str());
+  for (uint32_t i = n; i-- > 0;)
+    min_greater[i] = std::min(min_greater[i], min_greater[i + 1]);
 
-  char c = '\n';
-  if (write(opts.out, msg.c_str(), msg.size()) >= 0 &&
-      write(opts.out, &c, 1) >= 0) {
-    fsync(opts.out);
-  } else {
-    std::cerr << "sortcheck: failed to write to " << opts.out << " (errno "
-              << errno << ")\n";
-    abort();
-  }
+  if (!(opts.checks & SORTCHECK_CHECK_TRANSITIVITY))
+    return;
 
-  if (opts.abort) {
-    close(opts.out);
-    abort();
+  // !comp(x, y) for x placed before y means that x and y are equivalent
+  // and so are all elements between them
+  for (size_t i = 0; i < log.size(); ++i) {
+    if (log[i].rhs & TRACE_LESS)
+      continue;
+    const uint32_t lhs = log[i].lhs, rhs = log[i].rhs;
+    if (rank[lhs] < rank[rhs] && min_greater[rank[lhs]] <= rank[rhs]) {
+      report(site, ERROR_INCONSISTENT, lhs, rhs);
+    }
   }
-
-  if (opts.exit_code)
-    exit(opts.exit_code);
 }
 
 template <typename _RandomAccessIterator>
-inline void shuffle(_RandomAccessIterator __first,
-                    _RandomAccessIterator __last) {
-  unsigned &seed = const_cast<unsigned &>(get_options().shuffle);  // FIXME
-  size_t n = __last - __first;
-  for (_RandomAccessIterator lhs = __first; lhs != __last; ++lhs) {
-    _RandomAccessIterator rhs = __first + seed % n;
-    seed = seed * 1664525u + 1013904223u;
-    std::swap(*lhs, *rhs);
-  }
+inline bool can_trace(_RandomAccessIterator __first,
+                      _RandomAccessIterator __last) {
+  return size_t(__last - __first) <= TRACE_MAX_ELEMENTS;
 }
 
 template <typename _RandomAccessIterator, typename _Compare>
-inline void check_range(_RandomAccessIterator __first,
+inline void traced_sort(_RandomAccessIterator __first,
                         _RandomAccessIterator __last, _Compare __comp,
-                        const char *file, int line) {
+                        bool stable, Site &site) {
+  typedef typename std::iterator_traits<_RandomAccessIterator>::value_type
+      value_type;
+
+  const uint32_t n = __last - __first;
+
+  // Introsort makes at most ~2 * N * log2(N) comparisons
+  size_t log_n = 1;
+  while ((size_t(1) << log_n) < n)
+    ++log_n;
+  std::vector<TraceEntry> log;
+  log.reserve(std::min(n * (2 * log_n + 2), size_t(TRACE_MAX_ENTRIES)));
+
+  // Sorted indices are in [1, N] (see TracingCompare)
+  std::vector<uint32_t> perm(n + 2, n);
+  for (uint32_t i = 0; i < n; ++i)
+    perm[i + 1] = i;
+
+  TracingCompare<_RandomAccessIterator, _Compare> tracer(__first, n, __comp,
+                                                         &log);
+  if (stable)
+    std::stable_sort(perm.begin() + 1, perm.end() - 1, tracer);
+  else
+    std::sort(perm.begin() + 1, perm.end() - 1, tracer);
+  perm.pop_back();
+  perm.erase(perm.begin());
+
+  check_trace(log, perm, site);
+
+  // Apply permutation
+  std::vector<value_type> sorted;
+  sorted.reserve(n);
+  for (uint32_t i = 0; i < n; ++i)
+    sorted.push_back(SORTCHECK_MOVE(*(__first + perm[i])));
+  for (uint32_t i = 0; i < n; ++i)
+    *(__first + i) = SORTCHECK_MOVE(sorted[i]);
+}
+
+template <typename _ForwardIterator, typename _Compare>
+inline bool check_sorted(_ForwardIterator __first, _ForwardIterator __last,
+                         _Compare __comp, Site &site) {
   const Options &opts = get_options();
+  if (!(opts.checks & SORTCHECK_CHECK_SORTED) || __first == __last)
+    return false;
 
-  signed char cmp[32u][32u];
-  const size_t n =
-      std::min(size_t(__last - __first), sizeof(cmp) / sizeof(cmp[0]));
-  for (size_t i = 0; i < n; ++i) {
-    for (size_t j = 0; j < n; ++j) {
-      cmp[i][j] = __comp(*(__first + i), *(__first + j)) ? SORTCHECK_LESS
-                                                         : SORTCHECK_GREATER;
+  CheckStats stats(site, "check_sorted");
+  CountingCompare<_Compare> comp = stats.count(__comp);
+  bool found = false;
+  unsigned pos = 0;
+  for (_ForwardIterator cur = __first, prev = cur++; cur != __last;
+       ++prev, ++cur, ++pos) {
+    if (comp(*cur, *prev)) {
+      report(site, ERROR_UNSORTED, pos);
+      found = true;
     }
   }
+  stats.elements = pos + 1;
+  return found;
+}
 
-  for (size_t i = 0; i < n; ++i) {
-    for (size_t j = 0; j <= i; ++j) {
-      if (cmp[i][j] == SORTCHECK_GREATER && cmp[j][i] == SORTCHECK_GREATER)
-        cmp[i][j] = cmp[j][i] = SORTCHECK_EQUAL;
-    }
+// Verifies result of sort in O(N): range should consist of classes
+// of equivalent elements, each class less than the next one.
+// Every element is compared against head of its class
+// and heads of adjacent classes are compared against each other.
+template <typename _RandomAccessIterator, typename _Compare>
+inline void check_sorted_classes(_RandomAccessIterator __first,
+                                 _RandomAccessIterator __last, _Compare __comp,
+                                 Site &site) {
+  const Options &opts = get_options();
+  const size_t n = __last - __first;
+  if (!n)
+    return;
+
+  CheckStats stats(site, "check_sorted_classes");
+  stats.elements = n;
+  CountingCompare<_Compare> comp = stats.count(__comp);
+
+  size_t prev_head = n, head = 0;
+  if ((opts.checks & SORTCHECK_CHECK_REFLEXIVITY) &&
+      comp(*__first, *__first)) {
+    report(site, ERROR_REFLEXIVE, head);
   }
 
-  if (opts.checks & SORTCHECK_CHECK_REFLEXIVITY) {
-    for (size_t i = 0; i < n; ++i) {
-      if (cmp[i][i] != SORTCHECK_EQUAL) {
-        std::ostringstream os;
-        os << "sortcheck: " << file << ':' << line << ": "
-           << "reflexive comparator at position " << i;
-        report_error(os.str(), opts);
+  for (size_t i = 1; i < n; ++i) {
+    _RandomAccessIterator prev = __first + (i - 1), cur = __first + i,
+                          head_it = __first + head;
+
+    if (comp(*cur, *prev)) {
+      if (opts.checks & SORTCHECK_CHECK_SORTED) {
+        report(site, ERROR_UNSORTED, i - 1);
       }
+      continue;
     }
-  }
 
-  if (opts.checks & SORTCHECK_CHECK_SYMMETRY) {
-    for (size_t i = 0; i < n; ++i) {
-      for (size_t j = 0; j < i; ++j) {
-        if (cmp[i][j] != -cmp[j][i]) {
-          std::ostringstream os;
-          os << "sortcheck: " << file << ':' << line << ": "
-             << "non-asymmetric comparator at positions " << i << " and " << j;
-          report_error(os.str(), opts);
-        }
+    if (!comp(*prev, *cur)) {
+      // Same class: element must be equivalent to class head
+      if ((opts.checks & SORTCHECK_CHECK_TRANSITIVITY) &&
+          (comp(*head_it, *cur) || comp(*cur, *head_it))) {
+        report(site, ERROR_EQUIV_TRANSITIVE, head, i - 1, i);
       }
+      continue;
     }
-  }
 
-  if (opts.checks & SORTCHECK_CHECK_TRANSITIVITY) {
-    for (size_t i = 0; i < n; ++i) {
-      for (size_t j = 0; j < i; ++j) {
-        for (size_t k = 0; k < n; ++k) {
-          if (cmp[i][j] == cmp[j][k] && cmp[i][k] != cmp[i][j]) {
-            std::ostringstream os;
-            os << "sortcheck: " << file << ':' << line << ": "
-               << "non-transitive " << (cmp[i][j] ? "" : "equivalent ")
-               << "comparator at positions " << i << ", " << j << " and " << k;
-            report_error(os.str(), opts);
-          }
-        }
+    // New class starts: its head must be greater than heads of previous ones
+    if (opts.checks & SORTCHECK_CHECK_TRANSITIVITY) {
+      if (!comp(*head_it, *cur) || comp(*cur, *head_it)) {
+        report(site, ERROR_TRANSITIVE, head, i - 1, i);
+      } else if (prev_head != n && !comp(*(__first + prev_head), *cur)) {
+        report(site, ERROR_TRANSITIVE, prev_head, head, i);
       }
     }
-  }
-}
-
-template <typename _ForwardIterator, typename _Compare>
-inline void check_sorted(_ForwardIterator __first, _ForwardIterator __last,
-                         _Compare __comp, const char *file, int line) {
-  const Options &opts = get_options();
-  if (!(opts.checks & SORTCHECK_CHECK_SORTED) || __first == __last)
-    return;
 
-  unsigned pos = 0;
-  for (_ForwardIterator cur = __first, prev = cur++; cur != __last;
-       ++prev, ++cur, ++pos) {
-    if (__comp(*cur, *prev)) {
-      std::ostringstream os;
-      os << "sortcheck: " << file << ':' << line << ": "
-         << "unsorted range at position " << pos;
-      report_error(os.str(), opts);
+    prev_head = head;
+    head = i;
+    if ((opts.checks & SORTCHECK_CHECK_REFLEXIVITY) && comp(*cur, *cur)) {
+      report(site, ERROR_REFLEXIVE, head);
     }
   }
 }
 
 template <typename _ForwardIterator, typename _Tp, typename _Compare>
-inline void check_ordered(_ForwardIterator __first, _ForwardIterator __last,
-                          _Compare __comp, const _Tp &__val, const char *file,
-                          int line) {
+inline bool check_ordered(_ForwardIterator __first, _ForwardIterator __last,
+                          _Compare __comp, const _Tp &__val, Site &site) {
   const Options &opts = get_options();
   if (!(opts.checks & SORTCHECK_CHECK_ORDERED) || __first == __last)
-    return;
+    return false;
 
+  CheckStats stats(site, "check_ordered");
+  CountingCompare<_Compare> comp = stats.count(__comp);
+  bool found = false;
   int prev = SORTCHECK_LESS;
   unsigned pos = 0;
   for (_ForwardIterator it = __first; it != __last; ++it, ++pos) {
-    const int dir = __comp(*it, __val) ? SORTCHECK_LESS
-                                       : __comp(__val, *it) ? SORTCHECK_GREATER
+    const int dir = comp(*it, __val) ? SORTCHECK_LESS
+                                       : comp(__val, *it) ? SORTCHECK_GREATER
                                                             : SORTCHECK_EQUAL;
     if (dir < prev) {
-      std::ostringstream os;
-      os << "sortcheck: " << file << ':' << line << ": unsorted range "
-         << "at position " << pos;
-      report_error(os.str(), opts);
+      report(site, ERROR_UNSORTED, pos);
+      found = true;
     }
     prev = dir;
   }
+  stats.elements = pos;
+  return found;
 }
 
 // A simpler version of check_ordered when presense of __comp(__val, *iter)
 // is not guaranteed (e.g. in std::lower_bound).
 template <typename _ForwardIterator, typename _Tp, typename _Compare>
-inline void check_ordered_simple(_ForwardIterator __first,
+inline bool check_ordered_simple(_ForwardIterator __first,
                                  _ForwardIterator __last, _Compare __comp,
-                                 const _Tp &__val, const char *file, int line) {
+                                 const _Tp &__val, Site &site) {
   const Options &opts = get_options();
   if (!(opts.checks & SORTCHECK_CHECK_ORDERED) || __first == __last)
-    return;
+    return false;
 
+  CheckStats stats(site, "check_ordered_simple");
+  CountingCompare<_Compare> comp = stats.count(__comp);
+  bool found = false;
   int prev = SORTCHECK_LESS;
   unsigned pos = 0;
   for (_ForwardIterator it = __first; it != __last; ++it, ++pos) {
-    const int dir = __comp(*it, __val) ? SORTCHECK_LESS : SORTCHECK_GREATER;
+    const int dir = comp(*it, __val) ? SORTCHECK_LESS : SORTCHECK_GREATER;
     if (dir < prev) {
-      std::ostringstream os;
-      os << "sortcheck: " << file << ':' << line << ": unsorted range "
-         << "at position " << pos;
-      report_error(os.str(), opts);
+      report(site, ERROR_UNSORTED, pos);
+      found = true;
     }
     prev = dir;
   }
+  stats.elements = pos;
+  return found;
+}
+
+// Per-thread cache of ranges which were already verified to be sorted
+// by _full variants of binary search wrappers (SORTCHECK_CACHE).
+// Only checks which do not depend on searched value are cached.
+// Entries are invalidated by sorts (via global generation counter)
+// and by changes in elements or comparator state (via fingerprint).
+
+struct SortGeneration {
+  unsigned long value;
+  // Set if some range was cached since last increment of value
+  int armed;
+};
+
+inline SortGeneration &sort_generation() {
+  static SortGeneration generation;
+  return generation;
+}
+
+// Returns current generation for range which is about to be verified
+inline unsigned long arm_sort_generation() {
+  SortGeneration &g = sort_generation();
+  unsigned long value;
+  // Retry if concurrent sort disarmed generation after we read it
+  do {
+    if (!__atomic_load_n(&g.armed, __ATOMIC_RELAXED))
+      __atomic_store_n(&g.armed, 1, __ATOMIC_SEQ_CST);
+    value = __atomic_load_n(&g.value, __ATOMIC_SEQ_CST);
+  } while (!__atomic_load_n(&g.armed, __ATOMIC_SEQ_CST));
+  return value;
+}
+
+// Sorts only write shared counter if something was cached since last bump
+inline void bump_sort_generation() {
+  SortGeneration &g = sort_generation();
+  if (__atomic_load_n(&g.armed, __ATOMIC_RELAXED) &&
+      __atomic_exchange_n(&g.armed, 0, __ATOMIC_SEQ_CST))
+    __atomic_fetch_add(&g.value, 1, __ATOMIC_SEQ_CST);
+}
+
+struct VerifiedRange {
+  const void *first;
+  size_t size;
+  const void *comp;  // Address of TypeTag<_Compare>::id (state is in fingerprint)
+  const Site *site;
+  unsigned long generation;
+  uint64_t fingerprint;
+
+  bool operator==(const VerifiedRange &r) const {
+    return first == r.first && size == r.size && comp == r.comp &&
+           site == r.site && generation == r.generation &&
+           fingerprint == r.fingerprint;
+  }
+};
+
+enum { VERIFIED_CACHE_SIZE = 8 };
+
+struct VerifiedCache {
+  VerifiedRange entries[VERIFIED_CACHE_SIZE];
+  unsigned next;  // Round-robin replacement
+};
+
+inline VerifiedCache &get_verified_cache() {
+  static __thread VerifiedCache cache;
+  return cache;
+}
+
+template <typename T> struct TypeTag { static const char id; };
+template <typename T> const char TypeTag<T>::id = 0;
+
+template <typename T> struct IsReference { enum { value = 0 }; };
+template <typename T> struct IsReference<T &> { enum { value = 1 }; };
+
+template <typename T> struct IsRandomAccess { enum { value = 0 }; };
+template <> struct IsRandomAccess<std::random_access_iterator_tag> {
+  enum { value = 1 };
+};
+
+#if __cplusplus >= 201100L
+#define SORTCHECK_IS_TRIVIALLY_COPYABLE(T) std::is_trivially_copyable<T>::value
+#define SORTCHECK_IS_EMPTY(T) std::is_empty<T>::value
+#else
+#define SORTCHECK_IS_TRIVIALLY_COPYABLE(T) __is_trivially_copyable(T)
+#define SORTCHECK_IS_EMPTY(T) __is_empty(T)
+#endif
+
+// Only ranges of real objects with random access can be cached
+// (and only if they are trivially copyable: bytes of e.g. std::string
+// do not change together with its contents)
+template <typename _Iterator> struct IsCacheable {
+  typedef std::iterator_traits<_Iterator> traits;
+  enum {
+    value = IsReference<typename traits::reference>::value &&
+            IsRandomAccess<typename traits::iterator_category>::value &&
+            SORTCHECK_IS_TRIVIALLY_COPYABLE(typename traits::value_type)
+  };
+};
+
+template <typename _Iterator>
+inline bool describe_range(_Iterator, _Iterator, VerifiedRange &,
+                           BoolTag<false>) {
+  return false;
+}
+
+template <typename _Iterator>
+inline bool describe_range(_Iterator __first, _Iterator __last,
+                           VerifiedRange &r, BoolTag<true>) {
+  const size_t n = __last - __first;
+  if (!n)
+    return false;
+
+  r.first = &*__first;
+  r.size = n;
+  r.generation = arm_sort_generation();
+
+  // Hashing is much cheaper than comparisons in check_sorted
+  // and catches in-place changes anywhere in range
+  for (size_t i = 0; i < n; ++i) {
+    const void *p = &*(__first + i);
+    r.fingerprint = hash_bytes(r.fingerprint, p, sizeof(*__first));
+  }
+  return true;
+}
+
+// Adds state of comparator to fingerprint
+// (returns false if it can not be hashed)
+template <typename _Compare>
+inline bool describe_compare(const _Compare &comp, VerifiedRange &r) {
+  if (SORTCHECK_IS_EMPTY(_Compare))
+    return true;
+  if (!SORTCHECK_IS_TRIVIALLY_COPYABLE(_Compare))
+    return false;
+  r.fingerprint = hash_bytes(r.fingerprint, &comp, sizeof(comp));
+  return true;
+}
+
+// Looks up range in cache and remembers it once it's verified
+class VerifiedKey {
+  VerifiedRange key;
+  bool valid;
+
+public:
+  template <typename _Iterator, typename _Compare>
+  VerifiedKey(_Iterator __first, _Iterator __last, _Compare __comp,
+              const Site &site) {
+    key.comp = &TypeTag<_Compare>::id;
+    key.site = &site;
+    key.fingerprint = 0xcbf29ce484222325ull;
+    valid = get_options().cache && describe_compare(__comp, key) &&
+            describe_range(__first, __last, key,
+                           BoolTag<IsCacheable<_Iterator>::value>());
+  }
+
+  bool is_verified() const {
+    if (!valid)
+      return false;
+    const VerifiedCache &cache = get_verified_cache();
+    for (size_t i = 0; i < VERIFIED_CACHE_SIZE; ++i) {
+      if (cache.entries[i] == key)
+        return true;
+    }
+    return false;
+  }
+
+  void set_verified() const {
+    if (!valid)
+      return;
+    VerifiedCache &cache = get_verified_cache();
+    cache.entries[cache.next] = key;
+    cache.next = (cache.next + 1) % VERIFIED_CACHE_SIZE;
+  }
+};
+
+// Checks that range is partitioned wrt __val in O(log N):
+// finds partition point via bisection and then verifies
+// that few random elements lie at correct side of it (SORTCHECK_PROBES).
+template <typename _RandomAccessIterator, typename _Tp, typename _Compare>
+inline bool check_ordered_probes(_RandomAccessIterator __first,
+                                 _RandomAccessIterator __last, _Compare __comp,
+                                 const _Tp &__val, Site &site) {
+  const Options &opts = get_options();
+  if (!(opts.checks & SORTCHECK_CHECK_ORDERED) || __first == __last)
+    return false;
+
+  CheckStats stats(site, "check_ordered_probes");
+  CountingCompare<_Compare> comp = stats.count(__comp);
+
+  const size_t n = __last - __first;
+  size_t lo = 0, hi = n;
+  while (lo < hi) {
+    const size_t mid = lo + (hi - lo) / 2;
+    if (comp(*(__first + mid), __val))
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  stats.elements = stats.comparisons;  // Elements on bisection path
+
+  Random rng(next_seed() + n);
+  for (long i = 0; i < opts.probes; ++i) {
+    const size_t pos = rng.below(n);
+    ++stats.elements;
+    const bool less = comp(*(__first + pos), __val);
+    if (less != (pos < lo)) {
+      // Report position of smaller element like check_ordered_simple does
+      report(site, ERROR_UNSORTED, less ? pos : lo - 1);
+      return true;
+    }
+  }
+  return false;
+}
+
+template <typename _ForwardIterator, typename _Tp, typename _Compare>
+inline bool check_partitioned(_ForwardIterator __first,
+                              _ForwardIterator __last, _Compare __comp,
+                              const _Tp &__val, Site &site, BoolTag<false>) {
+  return check_ordered_simple(__first, __last, __comp, __val, site);
+}
+
+template <typename _ForwardIterator, typename _Tp, typename _Compare>
+inline bool check_partitioned(_ForwardIterator __first,
+                              _ForwardIterator __last, _Compare __comp,
+                              const _Tp &__val, Site &site, BoolTag<true>) {
+  if (get_options().probes < 0)
+    return check_ordered_simple(__first, __last, __comp, __val, site);
+  return check_ordered_probes(__first, __last, __comp, __val, site);
+}
+
+// Same as check_ordered_simple but in O(log N) if SORTCHECK_PROBES is set
+// and range has random access
+template <typename _ForwardIterator, typename _Tp, typename _Compare>
+inline bool check_partitioned(_ForwardIterator __first,
+                              _ForwardIterator __last, _Compare __comp,
+                              const _Tp &__val, Site &site) {
+  typedef typename std::iterator_traits<_ForwardIterator>::iterator_category
+      category;
+  return check_partitioned(__first, __last, __comp, __val, site,
+                           BoolTag<IsRandomAccess<category>::value>());
 }
 
 // binary_search overloads
@@ -285,36 +2513,44 @@ inline void check_ordered_simple(_ForwardIterator __first,
 template <typename _ForwardIterator, typename _Tp, typename _Compare>
 inline bool binary_search_checked(_ForwardIterator __first,
                                   _ForwardIterator __last, const _Tp &__val,
-                                  _Compare __comp, const char *file, int line) {
-  check_ordered(__first, __last, __comp, __val, file, line);
+                                  _Compare __comp, Site &site) {
+  if (should_check(site))
+    check_ordered(__first, __last, __comp, __val, site);
   return std::binary_search(__first, __last, __val, __comp);
 }
 
 template <typename _ForwardIterator, typename _Tp>
 inline bool binary_search_checked(_ForwardIterator __first,
                                   _ForwardIterator __last, const _Tp &__val,
-                                  const char *file, int line) {
-  return binary_search_checked(__first, __last, __val, Compare(), file, line);
+                                  Site &site) {
+  return binary_search_checked(__first, __last, __val, Compare(), site);
 }
 
 template <typename _ForwardIterator, typename _Tp, typename _Compare>
 inline bool
 binary_search_checked_full(_ForwardIterator __first, _ForwardIterator __last,
                            const _Tp &__val, _Compare __comp,
-                           bool do_check_range, const char *file, int line) {
-  if (do_check_range)
-    check_range(__first, __last, __comp, file, line);
-  check_sorted(__first, __last, __comp, file, line);
-  return binary_search_checked(__first, __last, __val, __comp, file, line);
+                           bool do_check_range, Site &site) {
+  if (should_check(site)) {
+    VerifiedKey key(__first, __last, __comp, site);
+    if (!key.is_verified()) {
+      bool found = do_check_range && check_range(__first, __last, __comp, site);
+      found |= check_sorted(__first, __last, __comp, site);
+      if (!found)
+        key.set_verified();
+    }
+    check_ordered(__first, __last, __comp, __val, site);
+  }
+  return std::binary_search(__first, __last, __val, __comp);
 }
 
 template <typename _ForwardIterator, typename _Tp>
 inline bool binary_search_checked_full(_ForwardIterator __first,
                                        _ForwardIterator __last,
                                        const _Tp &__val, bool do_check_range,
-                                       const char *file, int line) {
+                                       Site &site) {
   return binary_search_checked_full(__first, __last, __val, Compare(),
-                                    do_check_range, file, line);
+                                    do_check_range, site);
 }
 
 // lower_bound overloads
@@ -323,36 +2559,43 @@ template <typename _ForwardIterator, typename _Tp, typename _Compare>
 inline _ForwardIterator lower_bound_checked(_ForwardIterator __first,
                                             _ForwardIterator __last,
                                             const _Tp &__val, _Compare __comp,
-                                            const char *file, int line) {
-  check_ordered_simple(__first, __last, __comp, __val, file, line);
+                                            Site &site) {
+  if (should_check(site))
+    check_partitioned(__first, __last, __comp, __val, site);
   return std::lower_bound(__first, __last, __val, __comp);
 }
 
 template <typename _ForwardIterator, typename _Tp>
-inline _ForwardIterator
-lower_bound_checked(_ForwardIterator __first, _ForwardIterator __last,
-                    const _Tp &__val, const char *file, int line) {
-  return lower_bound_checked(__first, __last, __val, Compare(), file, line);
+inline _ForwardIterator lower_bound_checked(_ForwardIterator __first,
+                                            _ForwardIterator __last,
+                                            const _Tp &__val, Site &site) {
+  return lower_bound_checked(__first, __last, __val, Compare(), site);
 }
 
 template <typename _ForwardIterator, typename _Tp, typename _Compare>
 inline _ForwardIterator
 lower_bound_checked_full(_ForwardIterator __first, _ForwardIterator __last,
                          const _Tp &__val, _Compare __comp, bool do_check_range,
-                         const char *file, int line) {
-  if (do_check_range)
-    check_range(__first, __last, __comp, file, line);
-  check_sorted(__first, __last, __comp, file, line);
-  return lower_bound_checked(__first, __last, __val, __comp, file, line);
+                         Site &site) {
+  if (should_check(site)) {
+    VerifiedKey key(__first, __last, __comp, site);
+    if (!key.is_verified()) {
+      bool found = do_check_range && check_range(__first, __last, __comp, site);
+      found |= check_sorted(__first, __last, __comp, site);
+      if (!found)
+        key.set_verified();
+    }
+    check_ordered_simple(__first, __last, __comp, __val, site);
+  }
+  return std::lower_bound(__first, __last, __val, __comp);
 }
 
 template <typename _ForwardIterator, typename _Tp>
 inline _ForwardIterator
 lower_bound_checked_full(_ForwardIterator __first, _ForwardIterator __last,
-                         const _Tp &__val, bool do_check_range,
-                         const char *file, int line) {
+                         const _Tp &__val, bool do_check_range, Site &site) {
   return lower_bound_checked_full(__first, __last, __val, Compare(),
-                                  do_check_range, file, line);
+                                  do_check_range, site);
 }
 
 // upper_bound overloads
@@ -369,37 +2612,46 @@ template <typename _ForwardIterator, typename _Tp, typename _Compare>
 inline _ForwardIterator upper_bound_checked(_ForwardIterator __first,
                                             _ForwardIterator __last,
                                             const _Tp &__val, _Compare __comp,
-                                            const char *file, int line) {
-  CompareSwapped<_Compare> __comp_swapped(__comp);
-  check_ordered_simple(__first, __last, __comp_swapped, __val, file, line);
+                                            Site &site) {
+  if (should_check(site)) {
+    CompareSwapped<_Compare> __comp_swapped(__comp);
+    check_partitioned(__first, __last, __comp_swapped, __val, site);
+  }
   return std::upper_bound(__first, __last, __val, __comp);
 }
 
 template <typename _ForwardIterator, typename _Tp>
-inline _ForwardIterator
-upper_bound_checked(_ForwardIterator __first, _ForwardIterator __last,
-                    const _Tp &__val, const char *file, int line) {
-  return upper_bound_checked(__first, __last, __val, Compare(), file, line);
+inline _ForwardIterator upper_bound_checked(_ForwardIterator __first,
+                                            _ForwardIterator __last,
+                                            const _Tp &__val, Site &site) {
+  return upper_bound_checked(__first, __last, __val, Compare(), site);
 }
 
 template <typename _ForwardIterator, typename _Tp, typename _Compare>
 inline _ForwardIterator
 upper_bound_checked_full(_ForwardIterator __first, _ForwardIterator __last,
                          const _Tp &__val, _Compare __comp, bool do_check_range,
-                         const char *file, int line) {
-  if (do_check_range)
-    check_range(__first, __last, __comp, file, line);
-  check_sorted(__first, __last, __comp, file, line);
-  return upper_bound_checked(__first, __last, __val, __comp, file, line);
+                         Site &site) {
+  if (should_check(site)) {
+    VerifiedKey key(__first, __last, __comp, site);
+    if (!key.is_verified()) {
+      bool found = do_check_range && check_range(__first, __last, __comp, site);
+      found |= check_sorted(__first, __last, __comp, site);
+      if (!found)
+        key.set_verified();
+    }
+    CompareSwapped<_Compare> __comp_swapped(__comp);
+    check_ordered_simple(__first, __last, __comp_swapped, __val, site);
+  }
+  return std::upper_bound(__first, __last, __val, __comp);
 }
 
 template <typename _ForwardIterator, typename _Tp>
 inline _ForwardIterator
 upper_bound_checked_full(_ForwardIterator __first, _ForwardIterator __last,
-                         const _Tp &__val, bool do_check_range,
-                         const char *file, int line) {
+                         const _Tp &__val, bool do_check_range, Site &site) {
   return upper_bound_checked_full(__first, __last, __val, Compare(),
-                                  do_check_range, file, line);
+                                  do_check_range, site);
 }
 
 // equal_range overloads
@@ -407,37 +2659,43 @@ upper_bound_checked_full(_ForwardIterator __first, _ForwardIterator __last,
 template <typename _ForwardIterator, typename _Tp, typename _Compare>
 inline std::pair<_ForwardIterator, _ForwardIterator>
 equal_range_checked(_ForwardIterator __first, _ForwardIterator __last,
-                    const _Tp &__val, _Compare __comp, const char *file,
-                    int line) {
-  check_ordered_simple(__first, __last, __comp, __val, file, line);
+                    const _Tp &__val, _Compare __comp, Site &site) {
+  if (should_check(site))
+    check_partitioned(__first, __last, __comp, __val, site);
   return std::equal_range(__first, __last, __val, __comp);
 }
 
 template <typename _ForwardIterator, typename _Tp>
 inline std::pair<_ForwardIterator, _ForwardIterator>
 equal_range_checked(_ForwardIterator __first, _ForwardIterator __last,
-                    const _Tp &__val, const char *file, int line) {
-  return equal_range_checked(__first, __last, __val, Compare(), file, line);
+                    const _Tp &__val, Site &site) {
+  return equal_range_checked(__first, __last, __val, Compare(), site);
 }
 
 template <typename _ForwardIterator, typename _Tp, typename _Compare>
 inline std::pair<_ForwardIterator, _ForwardIterator>
 equal_range_checked_full(_ForwardIterator __first, _ForwardIterator __last,
                          const _Tp &__val, _Compare __comp, bool do_check_range,
-                         const char *file, int line) {
-  if (do_check_range)
-    check_range(__first, __last, __comp, file, line);
-  check_sorted(__first, __last, __comp, file, line);
-  return equal_range_checked(__first, __last, __val, __comp, file, line);
+                         Site &site) {
+  if (should_check(site)) {
+    VerifiedKey key(__first, __last, __comp, site);
+    if (!key.is_verified()) {
+      bool found = do_check_range && check_range(__first, __last, __comp, site);
+      found |= check_sorted(__first, __last, __comp, site);
+      if (!found)
+        key.set_verified();
+    }
+    check_ordered_simple(__first, __last, __comp, __val, site);
+  }
+  return std::equal_range(__first, __last, __val, __comp);
 }
 
 template <typename _ForwardIterator, typename _Tp>
 inline std::pair<_ForwardIterator, _ForwardIterator>
 equal_range_checked_full(_ForwardIterator __first, _ForwardIterator __last,
-                         const _Tp &__val, bool do_check_range,
-                         const char *file, int line) {
+                         const _Tp &__val, bool do_check_range, Site &site) {
   return equal_range_checked_full(__first, __last, __val, Compare(),
-                                  do_check_range, file, line);
+                                  do_check_range, site);
 }
 
 // sort overloads
@@ -445,19 +2703,33 @@ equal_range_checked_full(_ForwardIterator __first, _ForwardIterator __last,
 template <typename _RandomAccessIterator, typename _Compare>
 inline void sort_checked(_RandomAccessIterator __first,
                          _RandomAccessIterator __last, _Compare __comp,
-                         const char *file, int line) {
+                         Site &site) {
+  bump_sort_generation();
+  if (!should_check(site)) {
+    std::sort(__first, __last, __comp);
+    return;
+  }
+
   const Options &opts = get_options();
-  if (opts.shuffle != UINT_MAX)
-    shuffle(__first, __last);
-  check_range(__first, __last, __comp, file, line);
-  std::sort(__first, __last, __comp);
+  if (opts.trace && can_trace(__first, __last)) {
+    check_range(__first, __last, __comp, site, true,
+                std::min(opts.window, size_t(TRACE_WINDOW)));
+    traced_sort(__first, __last, __comp, false, site);
+  } else {
+    check_range(__first, __last, __comp, site, true,
+                choose_window(__first, __last, __comp, site));
+    const uint64_t start = read_cycles();
+    std::sort(__first, __last, __comp);
+    update_sort_cost(site, __last - __first, read_cycles() - start);
+  }
+  if (opts.post_check)
+    check_sorted_classes(__first, __last, __comp, site);
 }
 
 template <typename _RandomAccessIterator>
 inline void sort_checked(_RandomAccessIterator __first,
-                         _RandomAccessIterator __last, const char *file,
-                         int line) {
-  sort_checked(__first, __last, Compare(), file, line);
+                         _RandomAccessIterator __last, Site &site) {
+  sort_checked(__first, __last, Compare(), site);
 }
 
 // stable_sort overloads
@@ -465,16 +2737,33 @@ inline void sort_checked(_RandomAccessIterator __first,
 template <typename _RandomAccessIterator, typename _Compare>
 inline void stable_sort_checked(_RandomAccessIterator __first,
                                 _RandomAccessIterator __last, _Compare __comp,
-                                const char *file, int line) {
-  check_range(__first, __last, __comp, file, line);
-  std::stable_sort(__first, __last, __comp);
+                                Site &site) {
+  bump_sort_generation();
+  if (!should_check(site)) {
+    std::stable_sort(__first, __last, __comp);
+    return;
+  }
+
+  const Options &opts = get_options();
+  if (opts.trace && can_trace(__first, __last)) {
+    check_range(__first, __last, __comp, site, true,
+                std::min(opts.window, size_t(TRACE_WINDOW)));
+    traced_sort(__first, __last, __comp, true, site);
+  } else {
+    check_range(__first, __last, __comp, site, true,
+                choose_window(__first, __last, __comp, site));
+    const uint64_t start = read_cycles();
+    std::stable_sort(__first, __last, __comp);
+    update_sort_cost(site, __last - __first, read_cycles() - start);
+  }
+  if (opts.post_check)
+    check_sorted_classes(__first, __last, __comp, site);
 }
 
 template <typename _RandomAccessIterator>
 inline void stable_sort_checked(_RandomAccessIterator __first,
-                                _RandomAccessIterator __last, const char *file,
-                                int line) {
-  stable_sort_checked(__first, __last, Compare(), file, line);
+                                _RandomAccessIterator __last, Site &site) {
+  stable_sort_checked(__first, __last, Compare(), site);
 }
 
 // max_element overloads
@@ -482,16 +2771,17 @@ inline void stable_sort_checked(_RandomAccessIterator __first,
 template <typename _RandomAccessIterator, typename _Compare>
 inline _RandomAccessIterator
 max_element_checked(_RandomAccessIterator __first, _RandomAccessIterator __last,
-                    _Compare __comp, const char *file, int line) {
-  check_range(__first, __last, __comp, file, line);
+                    _Compare __comp, Site &site) {
+  if (should_check(site))
+    check_range(__first, __last, __comp, site);
   return std::max_element(__first, __last, __comp);
 }
 
 template <typename _RandomAccessIterator>
 inline _RandomAccessIterator max_element_checked(_RandomAccessIterator __first,
                                                  _RandomAccessIterator __last,
-                                                 const char *file, int line) {
-  return max_element_checked(__first, __last, Compare(), file, line);
+                                                 Site &site) {
+  return max_element_checked(__first, __last, Compare(), site);
 }
 
 // min_element overloads
@@ -499,47 +2789,205 @@ inline _RandomAccessIterator max_element_checked(_RandomAccessIterator __first,
 template <typename _RandomAccessIterator, typename _Compare>
 inline _RandomAccessIterator
 min_element_checked(_RandomAccessIterator __first, _RandomAccessIterator __last,
-                    _Compare __comp, const char *file, int line) {
-  check_range(__first, __last, __comp, file, line);
+                    _Compare __comp, Site &site) {
+  if (should_check(site))
+    check_range(__first, __last, __comp, site);
   return std::min_element(__first, __last, __comp);
 }
 
 template <typename _RandomAccessIterator>
 inline _RandomAccessIterator min_element_checked(_RandomAccessIterator __first,
                                                  _RandomAccessIterator __last,
-                                                 const char *file, int line) {
-  return min_element_checked(__first, __last, Compare(), file, line);
+                                                 Site &site) {
+  return min_element_checked(__first, __last, Compare(), site);
 }
 
 // std::map/set checks
 
-template <typename Compare> struct ComparePointers {
-  Compare comp;
-  ComparePointers(Compare c) : comp(c) {}
-  template <typename A, typename B> bool operator()(A *a, B *b) {
-    return comp(*a, *b);
-  }
+// Returns key of element (maps store pairs and sets store keys)
+template <typename Key, typename Value> struct KeyOf {
+  static const Key &get(const Value &v) { return v.first; }
 };
 
-template <typename Map> void check_map(Map *m, const char *file, int line) {
-  std::vector<const typename Map::key_type *> keys;
-  for (typename Map::iterator i = m->begin(), end = m->end(); i != end; ++i)
-    keys.push_back(&i->first);
+template <typename Key> struct KeyOf<Key, Key> {
+  static const Key &get(const Key &k) { return k; }
+};
+
+// Containers are not copied: pointers to at most MAX_CONTAINER_SAMPLE keys
+// are selected in single pass (in container order) and checked instead.
+enum { MAX_CONTAINER_SAMPLE = 1024 };
+
+// Number of keys needed to check container of given size
+inline size_t container_sample_size(size_t size) {
+  const Options &opts = get_options();
+  size_t n = MAX_CONTAINER_SAMPLE;
+  // Prefix and stride windows need only WINDOW elements
+  if (opts.window && opts.window_mode != WINDOW_CHUNKS && !opts.budget)
+    n = std::min(n, opts.window);
+  return std::min(n, size);
+}
+
+template <typename Container> void check_container(Container *m, Site &site) {
+  typedef typename Container::key_type key_type;
+  typedef KeyOf<key_type, typename Container::value_type> K;
+  if (!should_check(site))
+    return;
+
+  const key_type *keys[MAX_CONTAINER_SAMPLE];
+  const size_t size = m->size(), n = container_sample_size(size);
+
+  // Selection sampling (Knuth's Algorithm S): each remaining element
+  // is taken with probability (N - taken) / (SIZE - I)
+  size_t i = 0, taken = 0;
+  for (typename Container::const_iterator it = m->begin(), end = m->end();
+       it != end && taken < n; ++it, ++i) {
+    if (n == size || shuffle_random(size - i) < n - taken)
+      keys[taken++] = &K::get(*it);
+  }
+
+  // Reported positions refer to sample, not to container
+  SampledPositions guard(n < size);
+  check_range(keys, keys + taken,
+              ComparePointers<typename Container::key_compare>(m->key_comp()),
+              site, true);
+}
+
+template <typename Map> void check_map(Map *m, Site &site) {
+  check_container(m, site);
+}
+
+template <typename Set> void check_set(Set *m, Site &site) {
+  check_container(m, site);
+}
+
+// Incremental checks of std::map/set on insertion (SORTCHECK_INSERT_CHECK):
+// inserted element is compared against its neighbours, first and last
+// elements and elements at few random distances from it i.e. in O(1) time.
+// Containers are sorted by construction so element placed before
+// another one must not be greater than it.
+
+enum { INSERT_PROBES = 2, INSERT_MAX_DISTANCE = 8 };
+
+// Checks that LHS is placed before RHS correctly
+// (positions refer to sequence of checked elements)
+template <typename Container>
+inline void check_inserted_pair(const Container *c,
+                                typename Container::const_iterator lhs,
+                                size_t lhs_pos,
+                                typename Container::const_iterator rhs,
+                                size_t rhs_pos, bool unique,
+                                CheckStats &stats, Site &site) {
+  typedef KeyOf<typename Container::key_type, typename Container::value_type>
+      K;
   const Options &opts = get_options();
-  if (opts.shuffle != UINT_MAX)
-    shuffle(keys.begin(), keys.end());
-  check_range(keys.begin(), keys.end(), ComparePointers<typename Map::key_compare>(m->key_comp()), file, line);
+  CountingCompare<typename Container::key_compare> comp =
+      stats.count(c->key_comp());
+  const bool less = comp(K::get(*lhs), K::get(*rhs)),
+             greater = comp(K::get(*rhs), K::get(*lhs));
+  if (less && greater) {
+    if (opts.checks & SORTCHECK_CHECK_SYMMETRY)
+      report(site, ERROR_ASYMMETRIC, rhs_pos, lhs_pos);
+  } else if (greater || (unique && !less)) {
+    if (opts.checks & SORTCHECK_CHECK_TRANSITIVITY)
+      report(site, ERROR_INCONSISTENT, lhs_pos, rhs_pos);
+  }
 }
 
-template <typename Set> void check_set(Set *m, const char *file, int line) {
-  std::vector<const typename Set::key_type *> keys;
-  for (typename Set::iterator i = m->begin(), end = m->end(); i != end; ++i)
-    keys.push_back(&*i);
+template <typename Container>
+inline void check_inserted(const Container *c,
+                           typename Container::const_iterator it, bool unique,
+                           Site &site) {
+  typedef typename Container::const_iterator const_iterator;
+  typedef KeyOf<typename Container::key_type, typename Container::value_type>
+      K;
   const Options &opts = get_options();
-  if (opts.shuffle != UINT_MAX)
-    shuffle(keys.begin(), keys.end());
-  check_range(keys.begin(), keys.end(), ComparePointers<typename Set::key_compare>(m->key_comp()), file, line);
+  if (!opts.insert_check || !should_check(site))
+    return;
+
+  CheckStats stats(site, "check_inserted");
+
+  // Checked elements in container order: first element, few preceding
+  // elements, inserted element, few following elements and last element
+  // (errors report positions in this sequence because positions
+  // in container can not be computed in O(1))
+  enum { MAX_ELEMS = 2 * INSERT_PROBES + 5 };
+  const_iterator elems[MAX_ELEMS];
+  const_iterator *const mid = elems + MAX_ELEMS / 2;
+  const_iterator *first = mid, *last = mid + 1;
+  *mid = it;
+
+  const_iterator prev = it;
+  for (size_t i = 0; i <= INSERT_PROBES && prev != c->begin(); ++i) {
+    const size_t dist = i ? 1 + shuffle_random(INSERT_MAX_DISTANCE) : 1;
+    for (size_t j = 0; j < dist && prev != c->begin(); ++j) {
+      --prev;
+      ++stats.elements;
+    }
+    *--first = prev;
+  }
+  if (prev != c->begin())
+    *--first = c->begin();
+
+  const_iterator next = it, end = c->end();
+  --end;
+  for (size_t i = 0; i <= INSERT_PROBES && next != end; ++i) {
+    const size_t dist = i ? 1 + shuffle_random(INSERT_MAX_DISTANCE) : 1;
+    for (size_t j = 0; j < dist && next != end; ++j) {
+      ++next;
+      ++stats.elements;
+    }
+    *last++ = next;
+  }
+  if (next != end)
+    *last++ = end;
+
+  SampledPositions guard;
+  const size_t it_pos = mid - first;
+
+  if (opts.checks & SORTCHECK_CHECK_REFLEXIVITY) {
+    CountingCompare<typename Container::key_compare> comp =
+        stats.count(c->key_comp());
+    if (comp(K::get(*it), K::get(*it)))
+      report(site, ERROR_REFLEXIVE, it_pos);
+  }
+
+  for (const_iterator *e = first; e != mid; ++e)
+    check_inserted_pair(c, *e, e - first, it, it_pos, unique, stats, site);
+  for (const_iterator *e = mid + 1; e != last; ++e)
+    check_inserted_pair(c, it, it_pos, *e, e - first, unique, stats, site);
+}
+
+// Checks result of insert/emplace and returns it unchanged
+template <typename Container>
+inline typename Container::iterator
+checked_insert(const Container *c, typename Container::iterator it,
+               bool unique, Site &site) {
+  check_inserted(c, typename Container::const_iterator(it), unique, site);
+  return it;
+}
+
+template <typename Container>
+inline std::pair<typename Container::iterator, bool>
+checked_insert(const Container *c,
+               std::pair<typename Container::iterator, bool> res, bool unique,
+               Site &site) {
+  if (res.second)
+    check_inserted(c, typename Container::const_iterator(res.first), unique,
+                   site);
+  return res;
+}
+
+#if __cplusplus >= 201703L
+template <typename Container>
+inline typename Container::insert_return_type
+checked_insert(const Container *c, typename Container::insert_return_type res,
+               bool unique, Site &site) {
+  if (res.inserted)
+    check_inserted(c, typename Container::const_iterator(res.position), unique,
+                   site);
+  return res;
 }
+#endif
 
 } // namespace sortcheck
 
@@ -3,39 +3,46 @@
 // Use of this source code is governed by MIT license that can be
 // found in the LICENSE.txt file.
 
+#include "Visitor.h"
+
 #include "clang/Tooling/CommonOptionsParser.h"
 #include "clang/Tooling/Tooling.h"
 
 #include "clang/Rewrite/Core/Rewriter.h"
 
+#include "clang/Basic/FileManager.h"
+
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Frontend/FrontendAction.h"
 
-#include "clang/AST/RecursiveASTVisitor.h"
-#include "clang/AST/Type.h"
-#include "clang/Basic/Version.inc"
-
-#include "llvm/ADT/StringSwitch.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/VirtualFileSystem.h"
 #include "llvm/Support/raw_ostream.h"
 
-#include <optional>
+#include <map>
 #include <set>
 #include <string>
 #include <memory>
+#include <vector>
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 using namespace clang;
 using namespace clang::driver;
 using namespace clang::tooling;
-
-// Compatibility layer
-#if CLANG_VERSION_MAJOR <= 6
-#define getBeginLoc getLocStart
-#define getEndLoc getLocEnd
-#endif
-
-#ifndef LLVM_NODISCARD
-#define LLVM_NODISCARD [[nodiscard]]
-#endif
+using namespace sortchecker;
 
 namespace {
 
@@ -48,324 +55,394 @@ of Strict Weak Ordering axioms at runtime.\n");
 
 llvm::cl::opt<bool> Verbose("v", llvm::cl::desc("Turn on verbose output"));
 llvm::cl::opt<bool> IgnoreParseErrors("ignore-parse-errors", llvm::cl::desc("Ignore parser errors"));
+llvm::cl::opt<std::string> OutputDir("o", llvm::cl::desc("Write instrumented files to <dir>/<absolute path of file>\n"
+                                                         "instead of modifying them in place\n"
+                                                         "('-' prints them to stdout, each one preceded\n"
+                                                         "by '// SortChecker: <absolute path of file>' line)"),
+                                     llvm::cl::value_desc("dir"));
+llvm::cl::opt<std::string> ServerSocket("server", llvm::cl::desc("Serve instrumentation requests on Unix socket <path>\n"
+                                                                 "(see SORTCHECK_SERVER in scripts/cc)"),
+                                        llvm::cl::value_desc("path"));
+
+// Names of input files as given on command line (indexed by absolute path)
+std::map<std::string, std::string> SpelledNames;
+
+bool OutputFailed = false;
+
+std::string getAbsolutePath(llvm::StringRef Path) {
+  llvm::SmallString<256> Abs(Path);
+  llvm::sys::fs::make_absolute(Abs);
+  llvm::sys::path::remove_dots(Abs, /*remove_dot_dot*/ true);
+  return std::string(Abs.str());
+}
 
-class Visitor : public RecursiveASTVisitor<Visitor> {
-  ASTContext &Ctx;
-  Rewriter &RW;
-  std::set<FileID> ChangedFiles;
-
-  Expr *skipImplicitCasts(Expr *E) const {
-    while (auto *CE = dyn_cast<ImplicitCastExpr>(E)) {
-      E = CE->getSubExpr();
-    }
-    return E;
+// Name of file for #line directive in out-of-tree output
+std::string getLineName(const std::string &AbsPath) {
+  auto It = SpelledNames.find(AbsPath);
+  std::string Name = It != SpelledNames.end() ? It->second : AbsPath;
+  std::string Escaped;
+  for (char C : Name) {
+    if (C == '"' || C == '\\')
+      Escaped += '\\';
+    Escaped += C;
   }
+  return Escaped;
+}
 
-  void replaceCallee(DeclRefExpr *DRE, llvm::StringRef Replacement) const {
-    SourceRange Range = {DRE->getBeginLoc(), DRE->getEndLoc()};
-    RW.ReplaceText(Range, Replacement);
-  }
+class Consumer : public ASTConsumer {
+public:
+  Consumer(CompilerInstance &) {}
 
-  void appendLocationParams(CallExpr *E) const {
-    SourceLocation Loc = E->getRParenLoc();
-    RW.InsertTextBefore(Loc, ", __FILE__, __LINE__");
-  }
+  void HandleTranslationUnit(ASTContext &Ctx) override {
+    auto &SM = Ctx.getSourceManager();
+    Rewriter RW(SM, Ctx.getLangOpts());
+
+    Visitor V(Ctx, Verbose);
+    V.TraverseDecl(Ctx.getTranslationUnitDecl());
 
-  // Locate operator*() in D if it's a CXX class
-  CXXMethodDecl *findOperator(CXXRecordDecl *RD,
-                              OverloadedOperatorKind OpKind) const {
-    for (auto *Method : RD->methods()) {
-      if (Method->getOverloadedOperator() == OpKind) {
-        return Method;
+    // Replace calls
+    std::set<FileID> ChangedFiles;
+    for (auto &Site : V.getCallSites()) {
+      SourceRange Range = {Site.DRE->getBeginLoc(), Site.DRE->getEndLoc()};
+      RW.ReplaceText(Range, Site.WrapperName);
+      // Pass static descriptor of call site (see SORTCHECK_SITE)
+      RW.InsertTextBefore(Site.E->getRParenLoc(), ", SORTCHECK_SITE");
+      if (Site.CheckRangeFlag) {
+        RW.InsertTextBefore(Site.E->getRParenLoc(),
+                            *Site.CheckRangeFlag ? ", true" : ", false");
       }
+      ChangedFiles.insert(SM.getFileID(Site.E->getExprLoc()));
     }
-    for (auto &Base : RD->bases()) {
-      // TODO: consider access specifier?
-      auto *BaseRD = Base.getType()->getAsCXXRecordDecl();
-      if (auto *MD = findOperator(BaseRD, OpKind))
-        return MD;
+
+    // Insert includes followed by #line directive so that errors
+    // and diagnostics refer to original lines (and out-of-tree copies
+    // also to original files)
+    for (auto &FID : ChangedFiles) {
+      auto Loc = SM.getLocForStartOfFile(FID);
+      std::string Prologue = "#include <sortcheck.h>\n#line 1";
+      if (!OutputDir.empty())
+        Prologue += " \"" + getLineName(getPath(SM, FID)) + "\"";
+      RW.InsertText(Loc, Prologue + "\n");
     }
-    return nullptr;
-  }
 
-  bool isRandomAccessIterator(QualType Ty) const {
-    if (isa<PointerType>(Ty.getTypePtr()))
-      return true;
-    if (auto *RD = Ty->getAsCXXRecordDecl())
-      return findOperator(RD, OO_Plus);
-    return false;
+    if (OutputDir.empty()) {
+      // Modify files
+      RW.overwriteChangedFiles();
+      return;
+    }
+
+    for (auto &FID : ChangedFiles)
+      writeFile(getPath(SM, FID), RW.getEditBuffer(FID));
   }
 
-  QualType canonize(QualType Ty) const {
-    return Ty->getCanonicalTypeInternal();
+private:
+  static std::string getPath(SourceManager &SM, FileID FID) {
+    return getAbsolutePath(SM.getFileEntryForID(FID)->getName());
   }
 
-  // Return type of Ty's dereference
-  QualType getDereferencedType(QualType Ty) const {
-    if (auto *PTy = dyn_cast<PointerType>(Ty.getTypePtr())) {
-      return PTy->getPointeeType();
+  // Write instrumented file to OutputDir (atomically, as same header
+  // may be written by parallel jobs)
+  static void writeFile(const std::string &Path, const RewriteBuffer &Buf) {
+    if (OutputDir == "-") {
+      // Several files (sources or headers) may be printed
+      // so each one is preceded by delimiter with its name
+      llvm::outs() << "// SortChecker: " << Path << '\n';
+      Buf.write(llvm::outs());
+      return;
     }
 
-    if (auto *RD = Ty->getAsCXXRecordDecl()) {
-      if (auto *StarOp = findOperator(RD, OO_Star))
-        return canonize(StarOp->getReturnType());
+    llvm::SmallString<256> Out(OutputDir);
+    llvm::sys::path::append(Out, llvm::sys::path::relative_path(Path));
+
+    int FD;
+    llvm::SmallString<256> Tmp;
+    std::error_code EC =
+        llvm::sys::fs::create_directories(llvm::sys::path::parent_path(Out));
+    if (!EC)
+      EC = llvm::sys::fs::createUniqueFile(llvm::Twine(Out) + ".tmp-%%%%%%",
+                                           FD, Tmp);
+    if (!EC) {
+      llvm::raw_fd_ostream OS(FD, /*shouldClose*/ true);
+      Buf.write(OS);
+      OS.close();
+      if (OS.has_error()) {
+        EC = OS.error();
+        OS.clear_error();
+      }
+      if (!EC)
+        EC = llvm::sys::fs::rename(Tmp, Out);
+      if (EC)
+        llvm::sys::fs::remove(Tmp);
     }
 
-    return QualType();
+    if (EC) {
+      llvm::errs() << "SortChecker: failed to write " << Out << ": "
+                   << EC.message() << '\n';
+      OutputFailed = true;
+    }
   }
+};
 
-  Decl *getDecl(QualType Ty) const {
-    if (auto *TypedefTy = dyn_cast<TypedefType>(Ty.getTypePtr()))
-      return TypedefTy->getDecl();
-    if (auto *TagTy = dyn_cast<TagType>(Ty.getTypePtr()))
-      return TagTy->getDecl();
-    return nullptr;
+class InstrumentingAction : public ASTFrontendAction {
+public:
+  std::unique_ptr<ASTConsumer>
+  CreateASTConsumer(CompilerInstance &CI,
+                    LLVM_ATTRIBUTE_UNUSED llvm::StringRef InFile) override {
+    if (IgnoreParseErrors)
+      CI.getDiagnostics().setClient(new IgnoringDiagConsumer());
+    return std::make_unique<Consumer>(CI);
   }
 
-  llvm::StringRef getRootNamespace(const Decl *D) const {
-    llvm::StringRef RootNSName;
-    for (auto *DC = D->getDeclContext(); DC; DC = DC->getParent())
-      if (const auto *NS = dyn_cast<NamespaceDecl>(DC);
-          NS && NS->getIdentifier())
-        RootNSName = NS->getIdentifier()->getName();
-    return RootNSName;
-  }
+  void PrintHelp(llvm::raw_ostream &OS) { OS << "TODO\n"; }
+};
 
-  bool isStdType(QualType Ty) const {
-    Ty = dropReferences(Ty);
-    if (auto *D = getDecl(Ty)) {
-      return getRootNamespace(D) == "std";
-    }
-    return false;
-  }
+int runTool(int argc, const char **argv,
+            llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> FS =
+                llvm::vfs::getRealFileSystem(),
+            llvm::IntrusiveRefCntPtr<FileManager> Files = nullptr) {
+  auto Op = CommonOptionsParser::create(argc, argv, Category, llvm::cl::OneOrMore);
+  for (auto &Path : Op->getSourcePathList())
+    SpelledNames[getAbsolutePath(Path)] = Path;
+  ClangTool Tool(Op->getCompilations(), Op->getSourcePathList(),
+                 std::make_shared<PCHContainerOperations>(), FS, Files);
+  int Res = Tool.run(newFrontendActionFactory<InstrumentingAction>().get());
+  return Res ? Res : OutputFailed;
+}
 
-  bool isStdLess(QualType Ty) const {
-    if (auto *D = dyn_cast_or_null<NamedDecl>(getDecl(Ty))) {
-      std::string S;
-      llvm::raw_string_ostream OS(S);
-      D->printQualifiedName(OS);
-      return OS.str() == "std::less";
-    }
-    return false;
+// Server mode: requests are handled in forked children of server
+// so each job starts from already initialized process and toolchain
+// is probed only once. Server also reads headers which are included
+// by most sources (std headers) and fills file manager with them
+// so that children share them instead of opening and reading them
+// for every request. Other files are not cached across requests
+// because sources may change between them (server needs to be restarted
+// if toolchain is updated).
+
+// Paths to std headers (indexed by language)
+std::map<std::string, std::vector<std::string>> StdIncludes;
+
+std::vector<std::string> getStdIncludes(const std::string &Lang) {
+  std::vector<std::string> Incs;
+  std::string Cmd = "clang -x " + Lang + " -E -Wp,-v /dev/null 2>&1 >/dev/null";
+  FILE *P = popen(Cmd.c_str(), "r");
+  if (!P)
+    return Incs;
+  char Buf[4096];
+  while (fgets(Buf, sizeof(Buf), P)) {
+    if (strncmp(Buf, " /", 2) == 0)
+      Incs.push_back(llvm::StringRef(Buf).trim().str());
   }
+  if (pclose(P) != 0 || Incs.empty())
+    llvm::errs() << "SortChecker: failed to get std includes for " << Lang << '\n';
+  return Incs;
+}
 
-  bool isBuiltinType(QualType Ty) const {
-    Ty = dropReferences(Ty);
-    return isa<BuiltinType>(Ty);
+// Headers included by typical source file in given language
+std::vector<std::string> getCommonHeaders(const std::string &Lang) {
+  const char *Prelude =
+      Lang == "c" ? "#include <stdio.h>\n#include <stdlib.h>\n"
+                    "#include <string.h>\n"
+                  : "#include <algorithm>\n#include <functional>\n"
+                    "#include <map>\n#include <memory>\n#include <set>\n"
+                    "#include <string>\n#include <vector>\n";
+  std::string Cmd = "echo '" + std::string(Prelude) + "' | clang -x " + Lang +
+                    " -M - 2>/dev/null";
+  std::vector<std::string> Headers;
+  FILE *P = popen(Cmd.c_str(), "r");
+  if (!P)
+    return Headers;
+  // Output is a Makefile rule "-.o: header header \\ ..."
+  char Buf[4096];
+  while (fscanf(P, "%4095s", Buf) == 1) {
+    if (Buf[0] == '/')
+      Headers.push_back(Buf);
   }
+  pclose(P);
+  return Headers;
+}
 
-  QualType dropReferences(QualType Ty) const {
-    while (auto *RTy = dyn_cast<ReferenceType>(Ty.getTypePtr())) {
-      Ty = RTy->getPointeeType();
+// Contents of common headers and file manager which knows them
+// (see getCommonHeaders)
+llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> ServerFS;
+llvm::IntrusiveRefCntPtr<FileManager> ServerFiles;
+
+void loadCommonHeaders() {
+  llvm::IntrusiveRefCntPtr<llvm::vfs::InMemoryFileSystem> Cache(
+      new llvm::vfs::InMemoryFileSystem);
+  std::vector<std::string> Headers;
+  for (auto &Lang : {"c", "c++"}) {
+    for (auto &H : getCommonHeaders(Lang)) {
+      llvm::sys::fs::file_status St;
+      auto Buf = llvm::MemoryBuffer::getFile(H);
+      if (!Buf || llvm::sys::fs::status(H, St))
+        continue;
+      // Paths are cached as spelled by clang (i.e. relative
+      // to std include directories) so that children look them up
+      // under same names
+      if (Cache->addFile(H, llvm::sys::toTimeT(St.getLastModificationTime()),
+                         std::move(*Buf)))
+        Headers.push_back(H);
     }
-    return Ty;
   }
 
-  bool areTypesCompatible(QualType HaystackTy, QualType NeedleTy) const {
-    HaystackTy = dropReferences(HaystackTy);
-    NeedleTy = dropReferences(NeedleTy);
-    return HaystackTy.getTypePtr() == NeedleTy.getTypePtr();
-  }
+  llvm::IntrusiveRefCntPtr<llvm::vfs::OverlayFileSystem> FS(
+      new llvm::vfs::OverlayFileSystem(llvm::vfs::getRealFileSystem()));
+  FS->pushOverlay(Cache);
+  ServerFS = FS;
+  ServerFiles = new FileManager(FileSystemOptions(), ServerFS);
+  for (auto &H : Headers)
+    ServerFiles->getOptionalFileRef(H);
 
-  enum CompareFunction {
-    CMP_FUNC_UNKNOWN = 0,
-    CMP_FUNC_SORT,
-    CMP_FUNC_STABLE_SORT,
-    CMP_FUNC_BINARY_SEARCH,
-    CMP_FUNC_LOWER_BOUND,
-    CMP_FUNC_UPPER_BOUND,
-    CMP_FUNC_EQUAL_RANGE,
-    CMP_FUNC_MAX_ELEMENT,
-    CMP_FUNC_MIN_ELEMENT,
-    // TODO: other APIs from
-    // https://en.cppreference.com/w/cpp/named_req/Compare
-    CMP_FUNC_NUM
-  };
-
-  LLVM_NODISCARD bool isKindOfBinarySearch(CompareFunction func) const {
-    switch (func) {
-    case CMP_FUNC_BINARY_SEARCH:
-    case CMP_FUNC_LOWER_BOUND:
-    case CMP_FUNC_UPPER_BOUND:
-    case CMP_FUNC_EQUAL_RANGE:
-      return true;
-    default:
-      return false;
-    }
-  }
+  if (Verbose)
+    llvm::errs() << "SortChecker: cached " << Headers.size() << " headers\n";
+}
 
-  LLVM_NODISCARD bool isKindOfMaxElement(CompareFunction func) const {
-    switch (func) {
-    case CMP_FUNC_MAX_ELEMENT:
-    case CMP_FUNC_MIN_ELEMENT:
-      return true;
-    default:
+// Request starts with length of the rest of request (in bytes)
+// followed by NUL. The rest is a sequence of NUL-terminated fields:
+//   working directory, language ("c" or "c++"), number of arguments
+//   and SortChecker arguments (i.e. "-o dir files -- flags").
+enum { MAX_REQUEST_SIZE = 1 << 24, REQUEST_TIMEOUT = 10 };
+
+bool readAll(int FD, char *Buf, size_t Size) {
+  while (Size) {
+    ssize_t N = read(FD, Buf, Size);
+    if (N < 0 && errno == EINTR)
+      continue;
+    if (N <= 0)
       return false;
-    }
-  }
-
-  CompareFunction getCompareFunction(const std::string &Name) {
-    return llvm::StringSwitch<CompareFunction>(Name)
-        .Case("std::sort", CMP_FUNC_SORT)
-        .Case("std::stable_sort", CMP_FUNC_STABLE_SORT)
-        .Case("std::binary_search", CMP_FUNC_BINARY_SEARCH)
-        .Case("std::lower_bound", CMP_FUNC_LOWER_BOUND)
-        .Case("std::upper_bound", CMP_FUNC_UPPER_BOUND)
-        .Case("std::equal_range", CMP_FUNC_EQUAL_RANGE)
-        .Case("std::max_element", CMP_FUNC_MAX_ELEMENT)
-        .Case("std::min_element", CMP_FUNC_MIN_ELEMENT)
-        .Default(CMP_FUNC_UNKNOWN);
+    Buf += N;
+    Size -= N;
   }
+  return true;
+}
 
-  bool isBuiltinCompare(QualType KeyTy, bool HasDefaultCmp) const {
-    return HasDefaultCmp && (isBuiltinType(KeyTy) || isStdType(KeyTy));
-  }
+bool readRequest(int FD, std::vector<std::string> &Fields) {
+  // Client which stalls is dropped
+  timeval Timeout = {REQUEST_TIMEOUT, 0};
+  setsockopt(FD, SOL_SOCKET, SO_RCVTIMEO, &Timeout, sizeof(Timeout));
 
-  bool canInstrument(SourceLocation Loc, SourceManager &SM) const {
-    if (SM.isInSystemHeader(Loc))
+  std::string Len;
+  char C;
+  while (true) {
+    if (!readAll(FD, &C, 1) || Len.size() > 10)
       return false;
-    if (!Loc.isValid() || !Loc.isFileID())
+    if (!C)
+      break;
+    if (C < '0' || C > '9')
       return false;
-    return true;
+    Len += C;
   }
+  const size_t Size = strtoul(Len.c_str(), nullptr, 10);
+  if (Len.empty() || Size > MAX_REQUEST_SIZE)
+    return false;
 
-public:
-  Visitor(ASTContext &Ctx, Rewriter &RW) : Ctx(Ctx), RW(RW) {}
-
-#if 0
-  bool VisitExpr(Expr *E) {
-    llvm::errs() << "Expr at ";
-    E->getExprLoc().dump(Ctx.getSourceManager());
-    E->dump();
-    return true;
+  std::string Data(Size, 0);
+  if (!readAll(FD, &Data[0], Size) || (Size && Data.back()))
+    return false;
+  for (size_t Start = 0, End; Start < Size; Start = End + 1) {
+    End = Data.find('\0', Start);
+    Fields.push_back(Data.substr(Start, End - Start));
   }
-#endif
 
-  bool VisitCallExpr(CallExpr *E) {
-    auto &SM = Ctx.getSourceManager();
-    auto Loc = E->getExprLoc();
-    if (!canInstrument(Loc, SM))
-      return true;
-
-    auto *Callee = skipImplicitCasts(E->getCallee());
-    if (auto *DRE = dyn_cast<DeclRefExpr>(Callee)) {
-      std::string S;
-      llvm::raw_string_ostream OS(S);
-      DRE->getDecl()->printQualifiedName(OS);
-
-      auto LocStr = Loc.printToString(SM);
-      if (Verbose) {
-        llvm::errs() << "Found call to " << OS.str() << " at " << LocStr
-                     << '\n';
-      }
+  if (Fields.size() < 3 || (Fields[1] != "c" && Fields[1] != "c++"))
+    return false;
+  char *End;
+  const unsigned long NumArgs = strtoul(Fields[2].c_str(), &End, 10);
+  return !Fields[2].empty() && !*End && Fields.size() == 3 + NumArgs;
+}
 
-      do {
-        auto CmpFunc = getCompareFunction(OS.str());
-        if (!CmpFunc)
-          break;
-
-        if (Verbose) {
-          llvm::errs() << "Found relevant function " << OS.str() << "() at "
-                       << LocStr << ":\n";
-          Callee->dump();
-        }
-
-        static struct {
-          const char *WrapperName;
-          unsigned NumArgs;
-        } CompareFunctionInfo[CMP_FUNC_NUM] = {
-            {nullptr, 0},
-            {"sortcheck::sort_checked", 2},
-            {"sortcheck::stable_sort_checked", 2},
-            {"sortcheck::binary_search_checked", 3},
-            {"sortcheck::lower_bound_checked", 3},
-            {"sortcheck::upper_bound_checked", 3},
-            {"sortcheck::equal_range_checked", 3},
-            {"sortcheck::max_element_checked", 2},
-            {"sortcheck::min_element_checked", 2}};
-
-        std::string WrapperName = CompareFunctionInfo[CmpFunc].WrapperName;
-
-        auto IterTy = canonize(E->getArg(0)->getType());
-        auto DerefTy = canonize(getDereferencedType(IterTy));
-
-        const bool HasDefaultCmp =
-            E->getNumArgs() == CompareFunctionInfo[CmpFunc].NumArgs;
-        const bool IsBuiltinCompare = isBuiltinCompare(DerefTy, HasDefaultCmp);
-        const bool IsRandomAccess = isRandomAccessIterator(IterTy);
-
-        std::optional<bool> CheckRangeFlag;
-        if (isKindOfBinarySearch(CmpFunc)) {
-          // Enable additional checks if typeof(*__first) == _Tp
-          auto ValueTy = canonize(E->getArg(2)->getType());
-          if (IsRandomAccess && areTypesCompatible(ValueTy, DerefTy)) {
-            WrapperName += "_full";
-            CheckRangeFlag = !IsBuiltinCompare;
-          }
-        } else if (isKindOfMaxElement(CmpFunc)) {
-          if (IsBuiltinCompare || !IsRandomAccess)
-            break;
-        } else if (IsBuiltinCompare) {
-          // Do not instrument std::sort for primitive types
-          break;
-        }
-
-        replaceCallee(DRE, WrapperName);
-        appendLocationParams(E);
-        ChangedFiles.insert(SM.getFileID(Loc));
-
-        if (CheckRangeFlag) {
-          SourceLocation Loc = E->getRParenLoc();
-          RW.InsertTextBefore(Loc, *CheckRangeFlag ? ", true" : ", false");
-        }
-      } while (0);
-    }
-    return true;
+// Runs request with output redirected to socket;
+// response is terminated by NUL and exit code
+int handleRequest(int FD, const char *Argv0) {
+  if (dup2(FD, STDOUT_FILENO) < 0 || dup2(FD, STDERR_FILENO) < 0)
+    return 1;
+
+  std::vector<std::string> Fields;
+  int Res;
+  if (!readRequest(FD, Fields)) {
+    llvm::errs() << "SortChecker: malformed or incomplete request\n";
+    Res = 1;
+  } else if (chdir(Fields[0].c_str()) != 0) {
+    llvm::errs() << "SortChecker: failed to change directory to " << Fields[0]
+                 << ": " << strerror(errno) << '\n';
+    Res = 1;
+  } else {
+    std::vector<std::string> Args(Fields.begin() + 3, Fields.end());
+    for (auto &Inc : StdIncludes[Fields[1]])
+      Args.push_back("-I" + Inc);
+    std::vector<const char *> Argv = {Argv0};
+    for (auto &Arg : Args)
+      Argv.push_back(Arg.c_str());
+    llvm::cl::ResetAllOptionOccurrences();
+    Res = runTool(Argv.size(), Argv.data(), ServerFS, ServerFiles);
   }
 
-  const std::set<FileID> &getChangedFiles() const { return ChangedFiles; }
-};
+  llvm::outs().flush();
+  llvm::errs().flush();
+  std::string Trailer = '\0' + std::to_string(Res);
+  return write(STDOUT_FILENO, Trailer.data(), Trailer.size()) < 0 ? 1 : Res;
+}
 
-class Consumer : public ASTConsumer {
-public:
-  Consumer(CompilerInstance &) {}
+int runServer(const char *Argv0) {
+  sockaddr_un Addr = {};
+  Addr.sun_family = AF_UNIX;
+  if (ServerSocket.size() >= sizeof(Addr.sun_path)) {
+    llvm::errs() << "SortChecker: socket path is too long: " << ServerSocket << '\n';
+    return 1;
+  }
+  strcpy(Addr.sun_path, ServerSocket.c_str());
+
+  StdIncludes["c"] = getStdIncludes("c");
+  StdIncludes["c++"] = getStdIncludes("c++");
+  loadCommonHeaders();
+
+  int S = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(Addr.sun_path);
+  // Socket is created private to current user right away
+  // (changing its permissions later would leave a window for others)
+  mode_t OldMask = umask(077);
+  int BindRes =
+      S < 0 ? -1 : bind(S, reinterpret_cast<sockaddr *>(&Addr), sizeof(Addr));
+  umask(OldMask);
+  if (BindRes < 0 || listen(S, 128) < 0) {
+    llvm::errs() << "SortChecker: failed to listen on " << ServerSocket << ": "
+                 << strerror(errno) << '\n';
+    return 1;
+  }
 
-  void HandleTranslationUnit(ASTContext &Ctx) override {
-    auto &SM = Ctx.getSourceManager();
-    Rewriter RW(SM, Ctx.getLangOpts());
+  // Do not wait for children
+  signal(SIGCHLD, SIG_IGN);
 
-    // Replace calls
-    Visitor V(Ctx, RW);
-    V.TraverseDecl(Ctx.getTranslationUnitDecl());
+  if (Verbose)
+    llvm::errs() << "SortChecker: listening on " << ServerSocket << '\n';
 
-    // Insert includes
-    for (auto &FID : V.getChangedFiles()) {
-      auto Loc = SM.getLocForStartOfFile(FID);
-      RW.InsertText(Loc, "#include <sortcheck.h>\n");
+  while (true) {
+    int C = accept(S, nullptr, nullptr);
+    if (C < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      llvm::errs() << "SortChecker: accept failed: " << strerror(errno) << '\n';
+      return 1;
     }
-
-    // Modify files
-    RW.overwriteChangedFiles();
-  }
-};
-
-class InstrumentingAction : public ASTFrontendAction {
-public:
-  std::unique_ptr<ASTConsumer>
-  CreateASTConsumer(CompilerInstance &CI,
-                    LLVM_ATTRIBUTE_UNUSED llvm::StringRef InFile) override {
-    if (IgnoreParseErrors)
-      CI.getDiagnostics().setClient(new IgnoringDiagConsumer());
-    return std::make_unique<Consumer>(CI);
+    pid_t Pid = fork();
+    if (Pid == 0) {
+      close(S);
+      _exit(handleRequest(C, Argv0));
+    }
+    if (Pid < 0)
+      llvm::errs() << "SortChecker: fork failed: " << strerror(errno) << '\n';
+    close(C);
   }
-
-  void PrintHelp(llvm::raw_ostream &OS) { OS << "TODO\n"; }
-};
+}
 
 } // namespace
 
 int main(int argc, const char **argv) {
-  auto Op = CommonOptionsParser::create(argc, argv, Category, llvm::cl::OneOrMore);
-  ClangTool Tool(Op->getCompilations(), Op->getSourcePathList());
-  return Tool.run(newFrontendActionFactory<InstrumentingAction>().get());
+  // Server does not take input files so it is handled before
+  // CommonOptionsParser (which requires them)
+  if (argc > 1 && strncmp(argv[1], "--server", 8) == 0) {
+    llvm::cl::ParseCommandLineOptions(argc, argv, "SortChecker server\n");
+    return runServer(argv[0]);
+  }
+  return runTool(argc, argv);
 }
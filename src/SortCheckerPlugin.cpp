@@ -0,0 +1,310 @@
+// Copyright 2024 Yury Gribov
+//
+// Use of this source code is governed by MIT license that can be
+// found in the LICENSE.txt file.
+
+// Clang plugin which instruments calls found by Visitor during normal
+// compilation: instead of rewriting sources (like SortChecker tool does)
+// calls are redirected to sortcheck.h wrappers directly in AST
+// so sources are parsed only once. Use as
+//   clang++ -fplugin=path/to/SortChecker.so -include sortcheck.h \
+//     -Ipath/to/include ...
+
+#include "Visitor.h"
+
+#include "clang/AST/ASTConsumer.h"
+#include "clang/AST/Expr.h"
+#include "clang/AST/ExprCXX.h"
+#include "clang/AST/TemplateBase.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendPluginRegistry.h"
+#include "clang/Sema/Lookup.h"
+#include "clang/Sema/Sema.h"
+#include "clang/Sema/SemaConsumer.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SmallVector.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace clang;
+using namespace sortchecker;
+
+namespace {
+
+// Compatibility layer
+#if CLANG_VERSION_MAJOR >= 18
+#define ORDINARY_STRING_LITERAL StringLiteralKind::Ordinary
+#elif CLANG_VERSION_MAJOR >= 15
+#define ORDINARY_STRING_LITERAL StringLiteral::Ordinary
+#else
+#define ORDINARY_STRING_LITERAL StringLiteral::Ascii
+#endif
+
+// Returns argument of call before implicit conversions
+// (they will be redone for wrapper's parameters)
+Expr *getArgAsWritten(Expr *Arg) {
+  while (true) {
+    Arg = Arg->IgnoreImplicit();
+    auto *CE = dyn_cast<CXXConstructExpr>(Arg);
+    if (!CE || isa<CXXTemporaryObjectExpr>(CE) || CE->getNumArgs() != 1 ||
+        !CE->getConstructor()->isCopyOrMoveConstructor())
+      return Arg;
+    Arg = CE->getArg(0);
+  }
+}
+
+// Replaces instrumented calls in AST. Calls which are not children
+// of any statement (other than initializers of variables) can not be
+// replaced: these are whole constructor initializers (e.g. ": x(std::max(a, b))")
+// and default arguments.
+class Replacer : public RecursiveASTVisitor<Replacer> {
+  const llvm::DenseMap<Stmt *, Expr *> &Replacements;
+  llvm::DenseSet<Stmt *> Replaced;
+
+public:
+  explicit Replacer(const llvm::DenseMap<Stmt *, Expr *> &Replacements)
+      : Replacements(Replacements) {}
+
+  bool isReplaced(Stmt *S) const { return Replaced.count(S); }
+
+  bool VisitStmt(Stmt *S) {
+    for (Stmt *&Child : S->children()) {
+      auto It = Replacements.find(Child);
+      if (Child && It != Replacements.end()) {
+        Replaced.insert(Child);
+        Child = It->second;
+      }
+    }
+    return true;
+  }
+
+  // Initializers of global variables are not children of any statement
+  bool VisitVarDecl(VarDecl *VD) {
+    if (isa<ParmVarDecl>(VD))
+      return true;
+    auto It = Replacements.find(VD->getInit());
+    if (VD->getInit() && It != Replacements.end()) {
+      Replaced.insert(VD->getInit());
+      VD->setInit(It->second);
+    }
+    return true;
+  }
+};
+
+class Consumer : public SemaConsumer {
+  CompilerInstance &CI;
+  bool Verbose;
+  Sema *S = nullptr;
+  NamespaceDecl *Runtime = nullptr;
+  bool RuntimeMissing = false;
+  unsigned NextSiteId = 0;
+
+  // Namespace of sortcheck.h runtime
+  NamespaceDecl *getRuntime(SourceLocation Loc) {
+    if (Runtime || RuntimeMissing)
+      return Runtime;
+    auto &Ctx = CI.getASTContext();
+    LookupResult R(*S, &Ctx.Idents.get("sortcheck"), Loc,
+                   Sema::LookupNamespaceName);
+    S->LookupQualifiedName(R, Ctx.getTranslationUnitDecl());
+    Runtime = R.getAsSingle<NamespaceDecl>();
+    if (!Runtime) {
+      RuntimeMissing = true;
+      auto &Diags = CI.getDiagnostics();
+      unsigned ID = Diags.getCustomDiagID(
+          DiagnosticsEngine::Error,
+          "sortcheck.h is not included (use -include sortcheck.h)");
+      Diags.Report(Loc, ID);
+    }
+    return Runtime;
+  }
+
+  // Returns reference to (possibly overloaded) function from runtime
+  Expr *buildRuntimeRef(llvm::StringRef Name, SourceLocation Loc,
+                        const TemplateArgumentListInfo *TArgs = nullptr) {
+    auto &Ctx = CI.getASTContext();
+    LookupResult R(*S, &Ctx.Idents.get(Name), Loc, Sema::LookupOrdinaryName);
+    if (!S->LookupQualifiedName(R, Runtime) || R.empty())
+      return nullptr;
+    CXXScopeSpec SS;
+    ExprResult Res =
+        TArgs ? S->BuildTemplateIdExpr(SS, SourceLocation(), R,
+                                       /*RequiresADL*/ false, TArgs)
+              : S->BuildDeclarationNameExpr(SS, R, /*NeedsADL*/ false);
+    return Res.isInvalid() ? nullptr : Res.get();
+  }
+
+  // Builds sortcheck::plugin_site<Id>(file, line)
+  // (equivalent of SORTCHECK_SITE)
+  Expr *buildSite(SourceLocation Loc) {
+    auto &Ctx = CI.getASTContext();
+    auto &SM = Ctx.getSourceManager();
+    PresumedLoc PLoc = SM.getPresumedLoc(SM.getFileLoc(Loc));
+    if (PLoc.isInvalid())
+      return nullptr;
+
+    Expr *Id = IntegerLiteral::Create(
+        Ctx, llvm::APInt(Ctx.getIntWidth(Ctx.UnsignedIntTy), NextSiteId++),
+        Ctx.UnsignedIntTy, Loc);
+    TemplateArgumentListInfo TArgs(Loc, Loc);
+    TArgs.addArgument(TemplateArgumentLoc(TemplateArgument(Id), Id));
+    Expr *Fn = buildRuntimeRef("plugin_site", Loc, &TArgs);
+    if (!Fn)
+      return nullptr;
+
+    llvm::StringRef File = PLoc.getFilename();
+#if CLANG_VERSION_MAJOR >= 9
+    QualType FileTy = Ctx.getStringLiteralArrayType(Ctx.CharTy, File.size());
+#else
+    QualType FileTy = Ctx.getConstantArrayType(
+        Ctx.CharTy.withConst(), llvm::APInt(32, File.size() + 1),
+        ArrayType::Normal, 0);
+#endif
+    Expr *Args[] = {
+        StringLiteral::Create(Ctx, File, ORDINARY_STRING_LITERAL,
+                              /*Pascal*/ false, FileTy, Loc),
+        IntegerLiteral::Create(Ctx,
+                               llvm::APInt(Ctx.getIntWidth(Ctx.IntTy),
+                                           PLoc.getLine()),
+                               Ctx.IntTy, Loc)};
+    ExprResult Res = S->ActOnCallExpr(/*Scope*/ nullptr, Fn, Loc, Args, Loc);
+    return Res.isInvalid() ? nullptr : Res.get();
+  }
+
+  // Builds call to wrapper (returns null if it can not be built)
+  Expr *instrument(const CallSite &Site) {
+    auto &Ctx = CI.getASTContext();
+    CallExpr *E = Site.E;
+    SourceLocation Loc = E->getBeginLoc(), RParen = E->getRParenLoc();
+    if (!getRuntime(Loc))
+      return nullptr;
+
+    // Errors are not fatal: call is just left uninstrumented
+    Sema::SFINAETrap Trap(*S);
+
+    llvm::StringRef Name = Site.WrapperName;
+    Name.consume_front("sortcheck::");
+    Expr *Fn = buildRuntimeRef(Name, Loc);
+    Expr *SiteArg = buildSite(RParen);
+    if (!Fn || !SiteArg)
+      return nullptr;
+
+    llvm::SmallVector<Expr *, 6> Args;
+    for (unsigned I = 0; I < E->getNumArgs(); ++I)
+      Args.push_back(getArgAsWritten(E->getArg(I)));
+    if (Site.CheckRangeFlag) {
+      Args.push_back(new (Ctx)
+                         CXXBoolLiteralExpr(*Site.CheckRangeFlag, Ctx.BoolTy,
+                                            RParen));
+    }
+    Args.push_back(SiteArg);
+
+    ExprResult Res = S->ActOnCallExpr(/*Scope*/ nullptr, Fn, Loc, Args, RParen);
+    if (Res.isInvalid() || Trap.hasErrorOccurred())
+      return nullptr;
+
+    // Parent of original call already binds temporaries if needed
+    Expr *New = Res.get();
+    if (auto *BTE = dyn_cast<CXXBindTemporaryExpr>(New))
+      New = BTE->getSubExpr();
+    if (!Ctx.hasSameType(New->getType(), E->getType()) ||
+        New->getValueKind() != E->getValueKind())
+      return nullptr;
+    return New;
+  }
+
+public:
+  Consumer(CompilerInstance &CI, bool Verbose) : CI(CI), Verbose(Verbose) {}
+
+  void InitializeSema(Sema &SemaRef) override { S = &SemaRef; }
+
+  void ForgetSema() override { S = nullptr; }
+
+  // Called for each top-level declaration (and template instantiation)
+  // before it's passed to code generator
+  bool HandleTopLevelDecl(DeclGroupRef DG) override {
+    if (!S)
+      return true;
+    auto &Ctx = CI.getASTContext();
+    auto &SM = Ctx.getSourceManager();
+    for (Decl *D : DG) {
+      if (SM.isInSystemHeader(D->getLocation()))
+        continue;
+
+      Visitor V(Ctx, Verbose);
+      V.TraverseDecl(D);
+
+      llvm::DenseMap<Stmt *, Expr *> Replacements;
+      for (auto &Site : V.getCallSites()) {
+        // Templates are instrumented when they are instantiated
+        if (Site.DC && Site.DC->isDependentContext())
+          continue;
+        if (Expr *New = instrument(Site)) {
+          Replacements[Site.E] = New;
+        } else if (Verbose) {
+          llvm::errs() << "Failed to instrument call at "
+                       << Site.E->getExprLoc().printToString(SM) << '\n';
+        }
+      }
+
+      if (Replacements.empty())
+        continue;
+      Replacer R(Replacements);
+      R.TraverseDecl(D);
+
+      // Remark is used so that -Werror builds do not fail
+      for (auto &Site : V.getCallSites()) {
+        if (!Replacements.count(Site.E) || R.isReplaced(Site.E))
+          continue;
+        auto &Diags = CI.getDiagnostics();
+        unsigned ID = Diags.getCustomDiagID(
+            DiagnosticsEngine::Remark,
+            "call is not instrumented by SortChecker plugin "
+            "(calls in constructor initializers and default arguments "
+            "are not supported)");
+        Diags.Report(Site.E->getExprLoc(), ID);
+      }
+    }
+    return true;
+  }
+};
+
+class InstrumentingAction : public PluginASTAction {
+  bool Verbose = false;
+
+public:
+  bool ParseArgs(const CompilerInstance &CI,
+                 const std::vector<std::string> &Args) override {
+    for (auto &Arg : Args) {
+      if (Arg == "v") {
+        Verbose = true;
+      } else {
+        auto &Diags = CI.getDiagnostics();
+        unsigned ID = Diags.getCustomDiagID(
+            DiagnosticsEngine::Error, "unknown SortChecker argument '%0'");
+        Diags.Report(ID) << Arg;
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Calls must be replaced before code generator sees them
+  ActionType getActionType() override { return AddBeforeMainAction; }
+
+protected:
+  std::unique_ptr<ASTConsumer>
+  CreateASTConsumer(CompilerInstance &CI,
+                    LLVM_ATTRIBUTE_UNUSED llvm::StringRef InFile) override {
+    return std::make_unique<Consumer>(CI, Verbose);
+  }
+};
+
+} // namespace
+
+static FrontendPluginRegistry::Add<InstrumentingAction>
+    X("sortcheck", "instrument comparator APIs (see sortcheck.h)");
@@ -0,0 +1,131 @@
+// Copyright 2024 Yury Gribov
+//
+// Use of this source code is governed by MIT license that can be
+// found in the LICENSE.txt file.
+
+// Prints errors recorded in ring file by instrumented processes
+// (see SORTCHECK_OUTPUT=ring:path).
+
+#include <sortcheck.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+
+const char *me = "sortcheck-decode";
+
+void usage() {
+  std::cerr << "Usage: " << me << " [-h] [-t] ring\n"
+            << "Print errors recorded in SORTCHECK_OUTPUT=ring:path,\n"
+            << "oldest first.\n"
+            << "Options:\n"
+            << "  -t  prefix errors with time and thread ID\n";
+}
+
+bool is_older(const sortcheck::RingRecord &a, const sortcheck::RingRecord &b) {
+  return a.seq < b.seq;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  bool print_time = false;
+  const char *file = 0;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+      usage();
+      return 0;
+    } else if (strcmp(argv[i], "-t") == 0) {
+      print_time = true;
+    } else if (argv[i][0] != '-' && !file) {
+      file = argv[i];
+    } else {
+      usage();
+      return 1;
+    }
+  }
+  if (!file) {
+    usage();
+    return 1;
+  }
+
+  const size_t bytes = sortcheck::ring_bytes();
+
+  const int fd = open(file, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    std::cerr << me << ": failed to open " << file << ": " << strerror(errno)
+              << '\n';
+    return 1;
+  }
+  if (size_t(st.st_size) != bytes) {
+    std::cerr << me << ": " << file << " has unexpected size\n";
+    return 1;
+  }
+
+  void *p = mmap(0, bytes, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    std::cerr << me << ": failed to map " << file << ": " << strerror(errno)
+              << '\n';
+    return 1;
+  }
+
+  const sortcheck::RingHeader *hdr =
+      static_cast<const sortcheck::RingHeader *>(p);
+  if (hdr->magic != SORTCHECK_RING_MAGIC
+      || hdr->size != sortcheck::RING_SIZE) {
+    std::cerr << me << ": " << file << " is not a ring file\n";
+    return 1;
+  }
+
+  // Copy records so that they do not change under us; records which are
+  // being written (or were left incomplete by crashed process) are skipped
+  const sortcheck::RingRecord *ring =
+      reinterpret_cast<const sortcheck::RingRecord *>(hdr + 1);
+  std::vector<sortcheck::RingRecord> records;
+  for (size_t i = 0; i < sortcheck::RING_SIZE; ++i) {
+    const uint64_t seq = __atomic_load_n(&ring[i].seq, __ATOMIC_ACQUIRE);
+    if (!seq || (seq - 1) % sortcheck::RING_SIZE != i)
+      continue;
+    sortcheck::RingRecord r = ring[i];
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&ring[i].seq, __ATOMIC_RELAXED) != seq)
+      continue;
+    r.file[sizeof(r.file) - 1] = 0;
+    const int npos = r.npos & ~sortcheck::RING_SAMPLED;
+    if (r.kind < 0 || r.kind > sortcheck::ERROR_UNSORTED || npos < 1
+        || npos > 3)
+      continue;
+    records.push_back(r);
+  }
+  std::sort(records.begin(), records.end(), is_older);
+
+  for (size_t i = 0; i < records.size(); ++i) {
+    const sortcheck::RingRecord &r = records[i];
+    if (print_time) {
+      char buf[64];
+      const time_t sec = r.time / 1000000000;
+      struct tm tm;
+      strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", localtime_r(&sec, &tm));
+      std::cout << buf << '.' << std::setw(9) << std::setfill('0')
+                << r.time % 1000000000 << " [" << r.tid << "] ";
+    }
+    sortcheck::format_report(std::cout, r.file, r.line, r.kind,
+                             r.npos & ~sortcheck::RING_SAMPLED, r.pos,
+                             r.npos & sortcheck::RING_SAMPLED);
+    std::cout << '\n';
+  }
+
+  return 0;
+}
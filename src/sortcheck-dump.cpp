@@ -0,0 +1,97 @@
+// Copyright 2024 Yury Gribov
+//
+// Use of this source code is governed by MIT license that can be
+// found in the LICENSE.txt file.
+
+// Prints contents of report table shared by instrumented processes
+// (see SORTCHECK_REPORT_TABLE).
+
+#include <sortcheck.h>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char *me = "sortcheck-dump";
+
+void usage() {
+  std::cerr << "Usage: " << me << " [-h] table\n"
+            << "Print errors recorded in SORTCHECK_REPORT_TABLE,\n"
+            << "most frequent first.\n";
+}
+
+bool more_frequent(const sortcheck::ReportEntry *a,
+                   const sortcheck::ReportEntry *b) {
+  return a->count > b->count;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    usage();
+    return 1;
+  }
+  if (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0) {
+    usage();
+    return 0;
+  }
+
+  const char *file = argv[1];
+  const size_t bytes = sortcheck::report_table_bytes();
+
+  const int fd = open(file, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    std::cerr << me << ": failed to open " << file << ": " << strerror(errno)
+              << '\n';
+    return 1;
+  }
+  if (size_t(st.st_size) != bytes) {
+    std::cerr << me << ": " << file << " has unexpected size\n";
+    return 1;
+  }
+
+  void *p = mmap(0, bytes, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    std::cerr << me << ": failed to map " << file << ": " << strerror(errno)
+              << '\n';
+    return 1;
+  }
+
+  const sortcheck::ReportTableHeader *hdr =
+      static_cast<const sortcheck::ReportTableHeader *>(p);
+  if (hdr->magic != SORTCHECK_REPORT_TABLE_MAGIC
+      || hdr->size != sortcheck::REPORT_TABLE_SIZE) {
+    std::cerr << me << ": " << file << " is not a report table\n";
+    return 1;
+  }
+
+  // Entries which are still being filled by running processes are skipped
+  const sortcheck::ReportEntry *table =
+      reinterpret_cast<const sortcheck::ReportEntry *>(hdr + 1);
+  std::vector<const sortcheck::ReportEntry *> entries;
+  for (size_t i = 0; i < sortcheck::REPORT_TABLE_SIZE; ++i) {
+    if (__atomic_load_n(&table[i].ready, __ATOMIC_ACQUIRE))
+      entries.push_back(&table[i]);
+  }
+  std::stable_sort(entries.begin(), entries.end(), more_frequent);
+
+  for (size_t i = 0; i < entries.size(); ++i) {
+    const sortcheck::ReportEntry &e = *entries[i];
+    std::cout << e.file << ':' << e.line << ": "
+              << sortcheck::describe_error(e.kind) << ": " << e.count
+              << (e.count == 1 ? " time\n" : " times\n");
+  }
+
+  return 0;
+}
@@ -0,0 +1,32 @@
+// Copyright 2024 Yury Gribov
+// 
+// Use of this source code is governed by MIT license that can be
+// found in the LICENSE.txt file.
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+struct Compare {
+  bool operator()(int a, int b) const {
+    if (a == 7)
+      return true;
+    return a < b;
+  }
+};
+
+int main() {
+  for (int i = 0; i < 3; ++i) {
+    std::vector<int> v;
+    for (int j = 0; j < 40; ++j)
+      v.push_back(j);
+    std::stable_sort(v.begin(), v.end(), Compare());
+  }
+
+  // Checked in destructor
+  std::map<int, int, Compare> m;
+  m[1] = 1;
+  m[7] = 7;
+  m[2] = 2;
+  return 0;
+}
@@ -0,0 +1,46 @@
+#!/bin/sh
+
+# The MIT License (MIT)
+# 
+# Copyright (c) 2024 Yury Gribov
+# 
+# Use of this source code is governed by The MIT License (MIT)
+# that can be found in the LICENSE.txt file.
+
+# Check that SORTCHECK_ASYNC reports same errors as synchronous checks.
+
+set -eu
+#set -x
+
+cd $(dirname $0)
+
+ROOT=$PWD/../..
+PATH=$ROOT/scripts:$PATH
+
+CXXFLAGS='-Wall -Wextra -Werror -g -pthread'
+
+export SORTCHECK_ABORT=0
+export SORTCHECK_EXIT_CODE=0
+
+for std in c++98 c++11; do
+  c++ repro.cpp $CXXFLAGS -std=$std
+
+  ./a.out 2>&1 | sort > ref.log
+
+  # Order of reports is not deterministic
+  SORTCHECK_ASYNC=2 ./a.out 2>&1 | sort > test.log
+  if ! diff -q ref.log test.log; then
+    echo >&2 'Asynchronous checks did not produce expected output:'
+    diff ref.log test.log >&2
+    exit 1
+  fi
+done
+
+# Worker should be able to terminate program
+c++ repro.cpp $CXXFLAGS
+if SORTCHECK_ASYNC=2 SORTCHECK_EXIT_CODE=1 ./a.out > test.log 2>&1; then
+  echo >&2 'Asynchronous check did not terminate program'
+  exit 1
+fi
+
+echo SUCCESS
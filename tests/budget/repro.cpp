@@ -0,0 +1,25 @@
+// Copyright 2024 Yury Gribov
+// 
+// Use of this source code is governed by MIT license that can be
+// found in the LICENSE.txt file.
+
+#include <algorithm>
+#include <vector>
+
+// Cyclic (rock-scissors-paper) comparison for elements
+// outside of array prefix
+struct Compare {
+  bool operator()(int a, int b) {
+    if (a < 1000 || b < 1000)
+      return a < b;
+    return (a + 1) % 3 == b % 3;
+  }
+};
+
+int main() {
+  std::vector<int> v;
+  for (int i = 0; i < 10000; ++i)
+    v.push_back(i);
+  std::stable_sort(v.begin(), v.end(), Compare());
+  return 0;
+}
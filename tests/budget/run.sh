@@ -0,0 +1,45 @@
+#!/bin/sh
+
+# The MIT License (MIT)
+# 
+# Copyright (c) 2024 Yury Gribov
+# 
+# Use of this source code is governed by The MIT License (MIT)
+# that can be found in the LICENSE.txt file.
+
+# Check that SORTCHECK_BUDGET works.
+
+set -eu
+#set -x
+
+cd $(dirname $0)
+
+ROOT=$PWD/../..
+PATH=$ROOT/scripts:$PATH
+
+CXXFLAGS='-Wall -Wextra -Werror -g'
+
+c++ repro.cpp $CXXFLAGS
+
+export SORTCHECK_ABORT=0
+
+# Error is out of default window
+if ! ./a.out > test.log 2>&1; then
+  echo >&2 'Test unexpectedly failed'
+  cat test.log >&2
+  exit 1
+fi
+
+for opts in SORTCHECK_BUDGET=4096 'SORTCHECK_BUDGET=4096 SORTCHECK_WINDOW=0'; do
+  if env $opts ./a.out > test.log 2>&1; then
+    echo >&2 "Test did not fail as expected with $opts"
+    exit 1
+  fi
+  if ! grep -q 'non-transitive comparator' test.log; then
+    echo >&2 "Unexpected error message with $opts:"
+    cat test.log >&2
+    exit 1
+  fi
+done
+
+echo SUCCESS
@@ -0,0 +1,33 @@
+// Copyright 2024 Yury Gribov
+// 
+// Use of this source code is governed by MIT license that can be
+// found in the LICENSE.txt file.
+
+#include <algorithm>
+#include <vector>
+#include <stdio.h>
+
+static unsigned ncmp;
+
+struct Compare {
+  bool operator()(int a, int b) {
+    ++ncmp;
+    return a < b;
+  }
+};
+
+int main() {
+  std::vector<int> v;
+  for (int i = 0; i < 1000; ++i)
+    v.push_back(i);
+
+  for (int i = 0; i < 100; ++i)
+    std::binary_search(v.begin(), v.end(), i, Compare());
+  printf("%u comparisons\n", ncmp);
+
+  // Modified range must be checked again
+  v[0] = 2000;
+  std::binary_search(v.begin(), v.end(), 0, Compare());
+
+  return 0;
+}
@@ -0,0 +1,66 @@
+#!/bin/sh
+
+# The MIT License (MIT)
+# 
+# Copyright (c) 2024 Yury Gribov
+# 
+# Use of this source code is governed by The MIT License (MIT)
+# that can be found in the LICENSE.txt file.
+
+# Check that SORTCHECK_CACHE works.
+
+set -eu
+#set -x
+
+cd $(dirname $0)
+
+ROOT=$PWD/../..
+PATH=$ROOT/scripts:$PATH
+
+CXXFLAGS='-Wall -Wextra -Werror -g'
+
+c++ repro.cpp $CXXFLAGS
+
+export SORTCHECK_ABORT=0
+
+SORTCHECK_CACHE=0 ./a.out > test.log 2>&1 || true
+uncached=$(grep comparisons test.log | cut -d' ' -f1)
+
+if ./a.out > test.log 2>&1; then
+  echo >&2 'Test did not fail as expected'
+  exit 1
+fi
+cached=$(grep comparisons test.log | cut -d' ' -f1)
+
+# Only first lookup should check the whole range
+# (searched values are still checked in every lookup)
+if test $((cached * 3)) -gt $((uncached * 2)); then
+  echo >&2 "Cache did not reduce number of comparisons: $cached vs $uncached"
+  exit 1
+fi
+
+if ! grep -v comparisons test.log | diff repro.ref -; then
+  echo >&2 'Test did not produce expected output'
+  exit 1
+fi
+
+# Contents of non-trivial types are not cached
+c++ strings.cpp $CXXFLAGS
+if ./a.out > test.log 2>&1; then
+  echo >&2 'Test did not fail as expected'
+  exit 1
+fi
+if ! diff strings.ref test.log; then
+  echo >&2 'Test did not produce expected output'
+  exit 1
+fi
+
+# Searched values and comparator state are not cached
+c++ state.cpp $CXXFLAGS
+SORTCHECK_EXIT_CODE=0 SORTCHECK_MAX_REPORTS=1 ./a.out > test.log 2>&1
+if ! diff state.ref test.log; then
+  echo >&2 'Test did not produce expected output'
+  exit 1
+fi
+
+echo SUCCESS
@@ -0,0 +1,37 @@
+// Copyright 2024 Yury Gribov
+// 
+// Use of this source code is governed by MIT license that can be
+// found in the LICENSE.txt file.
+
+#include <algorithm>
+#include <vector>
+
+struct Key {
+  int x;
+};
+
+// Comparator with state; keys are compared with elements
+// via their remainders
+struct Compare {
+  bool ascending;
+  explicit Compare(bool ascending_) : ascending(ascending_) {}
+  bool operator()(int a, int b) const { return ascending ? a < b : b < a; }
+  bool operator()(int a, Key k) const { return a % 5 < k.x; }
+  bool operator()(Key k, int a) const { return k.x < a % 5; }
+};
+
+int main() {
+  std::vector<int> v;
+  for (int i = 0; i < 100; ++i)
+    v.push_back(i);
+
+  const Key all = {100}, some = {3};
+  // Other value is checked although range is already verified
+  for (int i = 0; i < 2; ++i)
+    std::binary_search(v.begin(), v.end(), i ? some : all, Compare(true));
+  // Comparator with other state is checked again
+  for (int i = 0; i < 2; ++i)
+    std::lower_bound(v.begin(), v.end(), all, Compare(i == 0));
+
+  return 0;
+}
@@ -0,0 +1,34 @@
+// Copyright 2024 Yury Gribov
+// 
+// Use of this source code is governed by MIT license that can be
+// found in the LICENSE.txt file.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <stdio.h>
+
+struct Compare {
+  bool operator()(const std::string &a, const std::string &b) {
+    return a < b;
+  }
+};
+
+int main() {
+  // Long strings whose contents are not stored inline
+  std::vector<std::string> v;
+  for (int i = 0; i < 100; ++i) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%03d-long-string-which-does-not-fit-inline", i);
+    v.push_back(buf);
+  }
+
+  for (int i = 0; i < 2; ++i) {
+    // Modified range must be checked again
+    if (i == 1)
+      v[0][0] = '9';
+    std::binary_search(v.begin(), v.end(), v[50], Compare());
+  }
+
+  return 0;
+}
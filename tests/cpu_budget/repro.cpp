@@ -0,0 +1,24 @@
+// Copyright 2024 Yury Gribov
+// 
+// Use of this source code is governed by MIT license that can be
+// found in the LICENSE.txt file.
+
+#include <algorithm>
+#include <vector>
+
+struct Compare {
+  bool operator()(int a, int b) const { return a < b; }
+};
+
+int main() {
+  std::vector<int> v;
+  for (int i = 0; i < 1000; ++i)
+    v.push_back(1000 - i);
+
+  for (int i = 0; i < 2000; ++i) {
+    std::vector<int> tmp(v);
+    std::sort(tmp.begin(), tmp.end(), Compare());
+  }
+
+  return 0;
+}
@@ -0,0 +1,48 @@
+#!/bin/sh
+
+# The MIT License (MIT)
+# 
+# Copyright (c) 2024 Yury Gribov
+# 
+# Use of this source code is governed by The MIT License (MIT)
+# that can be found in the LICENSE.txt file.
+
+# Check that SORTCHECK_CPU_BUDGET skips checks.
+
+set -eu
+#set -x
+
+cd $(dirname $0)
+
+ROOT=$PWD/../..
+PATH=$ROOT/scripts:$PATH
+
+CXXFLAGS='-Wall -Wextra -Werror -g'
+
+c++ repro.cpp $CXXFLAGS
+
+export SORTCHECK_STATS=stats.json
+export SORTCHECK_WINDOW=256
+
+# Expensive checks quickly exhaust budget
+# (also in tracing mode)
+for opts in SORTCHECK_TRACE=0 SORTCHECK_TRACE=1; do
+  env $opts SORTCHECK_CPU_BUDGET=0.1% ./a.out
+  python3 -c '
+import json, sys
+site = json.load(open(sys.argv[1]))["sites"][0]
+if not (site["checks"] > 0 and site["skipped"] > 0
+        and site["checks"] + site["skipped"] == site["calls"]):
+  sys.stderr.write("Unexpected statistics with %s: %s\n" % (sys.argv[2], site))
+  sys.exit(1)
+' $SORTCHECK_STATS $opts
+done
+
+if SORTCHECK_CPU_BUDGET=0 ./a.out > test.log 2>&1; then
+  echo >&2 'Invalid SORTCHECK_CPU_BUDGET was not detected'
+  exit 1
+fi
+
+rm -f $SORTCHECK_STATS
+
+echo SUCCESS
@@ -0,0 +1,52 @@
+#!/bin/sh
+
+# The MIT License (MIT)
+# 
+# Copyright (c) 2024 Yury Gribov
+# 
+# Use of this source code is governed by The MIT License (MIT)
+# that can be found in the LICENSE.txt file.
+
+# Check that SORTCHECK_DEDUP and SORTCHECK_MAX_REPORTS work.
+
+set -eu
+#set -x
+
+cd $(dirname $0)
+
+ROOT=$PWD/../..
+PATH=$ROOT/scripts:$PATH
+
+CXXFLAGS='-Wall -Wextra -Werror -g -pthread'
+
+c++ repro.cpp $CXXFLAGS
+
+export SORTCHECK_ABORT=0
+export SORTCHECK_EXIT_CODE=0
+
+./a.out > test.log 2>&1
+if test $(wc -l < test.log) != 24; then
+  echo >&2 'Unexpected number of reports:'
+  cat test.log >&2
+  exit 1
+fi
+
+for opts in SORTCHECK_DEDUP=1 SORTCHECK_MAX_REPORTS=1; do
+  ref=$(echo $opts | sed 's/SORTCHECK_\([A-Z_]*\)=.*/\1/' | tr A-Z_ a-z-).ref
+  env $opts ./a.out > test.log 2>&1
+  if ! diff -q $ref test.log; then
+    echo >&2 "Test did not produce expected output with $opts:"
+    diff $ref test.log >&2
+    exit 1
+  fi
+done
+
+# Limit applies to each call also when it's checked asynchronously
+SORTCHECK_ASYNC=1 SORTCHECK_MAX_REPORTS=1 ./a.out > test.log 2>&1
+if ! diff -q max-reports.ref test.log; then
+  echo >&2 "Test did not produce expected output with SORTCHECK_ASYNC=1:"
+  diff max-reports.ref test.log >&2
+  exit 1
+fi
+
+echo SUCCESS
@@ -0,0 +1,21 @@
+// Copyright 2024 Yury Gribov
+// 
+// Use of this source code is governed by MIT license that can be
+// found in the LICENSE.txt file.
+
+#include <map>
+
+// Rock-scissors-paper: each element is less than the next one (cyclically)
+struct Compare {
+  bool operator()(int lhs, int rhs) const {
+    return (lhs + 1) % 3 == rhs;
+  }
+};
+
+int main() {
+  std::map<int, int, Compare> v;
+  v[0] = 0;
+  v[1] = 1;
+  v[2] = 2;
+  return 0;
+}
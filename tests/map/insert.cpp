@@ -0,0 +1,21 @@
+// Copyright 2024 Yury Gribov
+// 
+// Use of this source code is governed by MIT license that can be
+// found in the LICENSE.txt file.
+
+#include <set>
+
+// Rock-scissors-paper: each element is less than the next one (cyclically)
+struct Compare {
+  bool operator()(int lhs, int rhs) const {
+    return (lhs + 1) % 3 == rhs;
+  }
+};
+
+int main() {
+  std::set<int, Compare> v;
+  v.insert(0);
+  v.insert(1);
+  v.insert(2);
+  return 0;
+}
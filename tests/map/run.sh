@@ -24,6 +24,14 @@ export SORTCHECK_ABORT=0
 for std in gnu++11 c++98 c++11 c++14 c++17; do
   for t in *.cpp; do
     stem=$(echo $t | sed 's/\.cpp//')
+    case $stem in
+    insert*)
+      export SORTCHECK_INSERT_CHECK=1
+      ;;
+    *)
+      export SORTCHECK_INSERT_CHECK=0
+      ;;
+    esac
     c++ $t $CXXFLAGS -std=$std
     ./a.out > test.log 2>&1 || true
     if ! diff -q $stem.ref test.log; then
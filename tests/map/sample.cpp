@@ -0,0 +1,27 @@
+// Copyright 2024 Yury Gribov
+// 
+// Use of this source code is governed by MIT license that can be
+// found in the LICENSE.txt file.
+
+#include <set>
+#include <vector>
+
+// Keys below 1000 are ordered normally
+// and others are compared like rock-scissors-paper
+struct Compare {
+  bool operator()(int lhs, int rhs) const {
+    if (lhs < 1000 || rhs < 1000)
+      return lhs < rhs;
+    return (lhs + 1) % 3 == rhs % 3;
+  }
+};
+
+int main() {
+  std::vector<int> keys;
+  for (int i = 0; i < 10000; ++i)
+    keys.push_back(i);
+  // Range constructor does not check inserted elements
+  std::set<int, Compare> v(keys.begin(), keys.end());
+  v.clear();
+  return 0;
+}
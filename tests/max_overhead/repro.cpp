@@ -0,0 +1,25 @@
+// Copyright 2024 Yury Gribov
+// 
+// Use of this source code is governed by MIT license that can be
+// found in the LICENSE.txt file.
+
+#include <algorithm>
+#include <stdlib.h>
+#include <vector>
+
+// First two elements are both less than each other
+struct Compare {
+  bool operator()(int a, int b) const {
+    if ((a == 0 && b == 1) || (a == 1 && b == 0))
+      return true;
+    return a < b;
+  }
+};
+
+int main(int argc, char **argv) {
+  std::vector<int> v;
+  for (int i = 0, n = atoi(argv[argc - 1]); i < n; ++i)
+    v.push_back(i);
+  std::stable_sort(v.begin(), v.end(), Compare());
+  return 0;
+}
@@ -0,0 +1,63 @@
+#!/bin/sh
+
+# The MIT License (MIT)
+# 
+# Copyright (c) 2024 Yury Gribov
+# 
+# Use of this source code is governed by The MIT License (MIT)
+# that can be found in the LICENSE.txt file.
+
+# Check that SORTCHECK_MAX_OVERHEAD adapts window to size of sorted range.
+
+set -eu
+#set -x
+
+cd $(dirname $0)
+
+ROOT=$PWD/../..
+PATH=$ROOT/scripts:$PATH
+
+CXXFLAGS='-Wall -Wextra -Werror -g'
+
+c++ repro.cpp $CXXFLAGS
+
+export SORTCHECK_ABORT=0
+export SORTCHECK_EXIT_CODE=0
+# Do not depend on timings
+export SORTCHECK_FIXED_COST=10
+
+# Small range is checked by default...
+./a.out 10 > test.log 2>&1
+if ! diff -q repro.ref test.log; then
+  echo >&2 'Test did not produce expected output by default:'
+  diff repro.ref test.log >&2
+  exit 1
+fi
+
+# ... but checking it does not fit 5% of sort time
+SORTCHECK_MAX_OVERHEAD=5% ./a.out 10 > test.log 2>&1
+if test -s test.log; then
+  echo >&2 'Unexpected output for small range:'
+  cat test.log >&2
+  exit 1
+fi
+
+# Large range is checked
+SORTCHECK_MAX_OVERHEAD=0.05 ./a.out 100000 > test.log 2>&1
+if ! diff -q repro.ref test.log; then
+  echo >&2 'Test did not produce expected output for large range:'
+  diff repro.ref test.log >&2
+  exit 1
+fi
+
+if SORTCHECK_MAX_OVERHEAD=5x ./a.out 10 > test.log 2>&1; then
+  echo >&2 'Invalid SORTCHECK_MAX_OVERHEAD was not detected'
+  exit 1
+fi
+
+if SORTCHECK_FIXED_COST=0 SORTCHECK_MAX_OVERHEAD=5% ./a.out 10 > test.log 2>&1; then
+  echo >&2 'Invalid SORTCHECK_FIXED_COST was not detected'
+  exit 1
+fi
+
+echo SUCCESS
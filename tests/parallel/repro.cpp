@@ -0,0 +1,24 @@
+// Copyright 2024 Yury Gribov
+// 
+// Use of this source code is governed by MIT license that can be
+// found in the LICENSE.txt file.
+
+#include <algorithm>
+#include <vector>
+
+// Element 150 is equivalent to its neighbors
+struct Compare {
+  bool operator()(int a, int b) const {
+    if (a == 150 || b == 150)
+      return a + 1 < b;
+    return a < b;
+  }
+};
+
+int main() {
+  std::vector<int> v;
+  for (int i = 0; i < 200; ++i)
+    v.push_back(i * 37 % 200);
+  std::stable_sort(v.begin(), v.end(), Compare());
+  return 0;
+}
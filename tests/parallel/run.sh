@@ -0,0 +1,42 @@
+#!/bin/sh
+
+# The MIT License (MIT)
+# 
+# Copyright (c) 2024 Yury Gribov
+# 
+# Use of this source code is governed by The MIT License (MIT)
+# that can be found in the LICENSE.txt file.
+
+# Check that SORTCHECK_THREADS produces same results as serial checks.
+
+set -eu
+#set -x
+
+cd $(dirname $0)
+
+ROOT=$PWD/../..
+PATH=$ROOT/scripts:$PATH
+
+CXXFLAGS='-Wall -Wextra -Werror -g -pthread -fsanitize=thread'
+
+c++ repro.cpp $CXXFLAGS
+
+export SORTCHECK_ABORT=0
+export SORTCHECK_EXIT_CODE=0
+export SORTCHECK_WINDOW=200
+export TSAN_OPTIONS=halt_on_error=1
+
+./a.out > ref.log 2>&1
+if ! grep -q 'non-transitive' ref.log; then
+  echo >&2 'Serial check did not detect error'
+  exit 1
+fi
+
+SORTCHECK_THREADS=4 ./a.out > test.log 2>&1
+if ! diff -q ref.log test.log; then
+  echo >&2 'Parallel check did not produce expected output:'
+  diff ref.log test.log >&2
+  exit 1
+fi
+
+echo SUCCESS
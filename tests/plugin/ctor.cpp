@@ -0,0 +1,18 @@
+#include <algorithm>
+#include <vector>
+
+struct Less {
+  bool operator()(int a, int b) const { return a < b; }
+};
+
+// Call in constructor initializer can not be instrumented by plugin
+struct Finder {
+  bool found;
+  Finder(const std::vector<int> &v, int x)
+    : found(std::binary_search(v.begin(), v.end(), x, Less())) {}
+};
+
+int main() {
+  std::vector<int> v(10);
+  return Finder(v, 0).found ? 0 : 1;
+}
@@ -0,0 +1,53 @@
+#!/bin/sh
+
+# The MIT License (MIT)
+# 
+# Copyright (c) 2023 Yury Gribov
+# 
+# Use of this source code is governed by The MIT License (MIT)
+# that can be found in the LICENSE.txt file.
+
+# Check instrumentation via Clang plugin.
+
+set -eu
+#set -x
+
+cd $(dirname $0)
+
+ROOT=$PWD/../..
+PATH=$ROOT/scripts:$PATH
+
+CXXFLAGS='-Wall -Wextra -Werror -g'
+
+export SORTCHECK_ABORT=0
+
+check() {
+  if ! diff -q $1 test.log; then
+    echo >&2 'Test did not produce expected output:'
+    diff $1 test.log >&2
+    exit 1
+  fi
+}
+
+# Reports refer to file names so compile in test directory
+REPRO=$PWD/../rock-scissors-paper
+
+# Plain clang++
+(cd $REPRO && clang++ -fplugin=$ROOT/bin/SortChecker.so -I$ROOT/include -include sortcheck.h repro.cpp $CXXFLAGS -o $OLDPWD/a.out)
+./a.out > test.log 2>&1 || true
+check $REPRO/repro.ref
+
+# Wrapper (GCC-specific flags should be filtered out)
+(cd $REPRO && SORTCHECK_PLUGIN=1 c++ repro.cpp $CXXFLAGS -fvar-tracking-assignments -o $OLDPWD/a.out)
+./a.out > test.log 2>&1 || true
+check $REPRO/repro.ref
+
+# Unsupported calls should be reported
+clang++ -fplugin=$ROOT/bin/SortChecker.so -I$ROOT/include -include sortcheck.h ctor.cpp $CXXFLAGS > test.log 2>&1
+if ! grep -q 'ctor.cpp:12:.*not instrumented by SortChecker plugin' test.log; then
+  echo >&2 'Plugin did not report call in constructor initializer'
+  cat test.log >&2
+  exit 1
+fi
+
+echo SUCCESS
@@ -0,0 +1,22 @@
+// Copyright 2024 Yury Gribov
+// 
+// Use of this source code is governed by MIT license that can be
+// found in the LICENSE.txt file.
+
+#include <algorithm>
+#include <vector>
+
+// Fuzzy comparison (non-transitive equivalence)
+struct Compare {
+  bool operator()(int a, int b) {
+    return a + 2 < b;
+  }
+};
+
+int main() {
+  std::vector<int> v;
+  for (int i = 0; i < 100; ++i)
+    v.push_back(i * 37 % 101);
+  std::stable_sort(v.begin(), v.end(), Compare());
+  return 0;
+}
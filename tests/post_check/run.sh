@@ -0,0 +1,53 @@
+#!/bin/sh
+
+# The MIT License (MIT)
+# 
+# Copyright (c) 2024 Yury Gribov
+# 
+# Use of this source code is governed by The MIT License (MIT)
+# that can be found in the LICENSE.txt file.
+
+# Check that SORTCHECK_POST_CHECK works.
+
+set -eu
+#set -x
+
+cd $(dirname $0)
+
+ROOT=$PWD/../..
+PATH=$ROOT/scripts:$PATH
+
+CXXFLAGS='-Wall -Wextra -Werror -g'
+
+export SORTCHECK_ABORT=0
+export SORTCHECK_POST_CHECK=1
+
+c++ good.cpp $CXXFLAGS
+if ! ./a.out > test.log 2>&1; then
+  echo >&2 'Valid comparator unexpectedly failed'
+  cat test.log >&2
+  exit 1
+fi
+
+c++ repro.cpp $CXXFLAGS
+
+# Disable prior checks so that only post-check can detect the error
+export SORTCHECK_WINDOW=0
+
+if ! SORTCHECK_POST_CHECK=0 ./a.out > test.log 2>&1; then
+  echo >&2 'Test unexpectedly failed without post-check'
+  cat test.log >&2
+  exit 1
+fi
+
+if ./a.out > test.log 2>&1; then
+  echo >&2 'Post-check did not detect error'
+  exit 1
+fi
+if ! grep -q 'non-transitive equivalent comparator' test.log; then
+  echo >&2 'Unexpected error message:'
+  cat test.log >&2
+  exit 1
+fi
+
+echo SUCCESS
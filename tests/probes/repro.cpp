@@ -0,0 +1,32 @@
+// Copyright 2024 Yury Gribov
+// 
+// Use of this source code is governed by MIT license that can be
+// found in the LICENSE.txt file.
+
+#include <algorithm>
+#include <vector>
+#include <stdio.h>
+
+static unsigned ncmp;
+
+struct Elem {
+  int x;
+};
+
+struct Compare {
+  bool operator()(const Elem &a, int b) {
+    ++ncmp;
+    return a.x < b;
+  }
+};
+
+int main() {
+  std::vector<Elem> v;
+  for (int i = 0; i < 1000; ++i) {
+    Elem e = {600 <= i && i < 800 ? 0 : i};
+    v.push_back(e);
+  }
+  std::lower_bound(v.begin(), v.end(), 250, Compare());
+  printf("%u comparisons\n", ncmp);
+  return 0;
+}
@@ -0,0 +1,48 @@
+#!/bin/sh
+
+# The MIT License (MIT)
+# 
+# Copyright (c) 2024 Yury Gribov
+# 
+# Use of this source code is governed by The MIT License (MIT)
+# that can be found in the LICENSE.txt file.
+
+# Check that SORTCHECK_PROBES works.
+
+set -eu
+#set -x
+
+cd $(dirname $0)
+
+ROOT=$PWD/../..
+PATH=$ROOT/scripts:$PATH
+
+CXXFLAGS='-Wall -Wextra -Werror -g'
+
+c++ repro.cpp $CXXFLAGS
+
+export SORTCHECK_ABORT=0
+export SORTCHECK_EXIT_CODE=0
+
+# Bisection path alone does not hit unsorted part
+SORTCHECK_PROBES=0 ./a.out > test.log 2>&1
+if grep -q 'unsorted range' test.log; then
+  echo >&2 'Unexpected error without probes'
+  cat test.log >&2
+  exit 1
+fi
+
+SORTCHECK_PROBES=32 ./a.out > test.log 2>&1
+if ! grep -q 'unsorted range' test.log; then
+  echo >&2 'Random probes did not detect error'
+  exit 1
+fi
+
+# Probes are much cheaper than linear scan
+ncmp=$(grep comparisons test.log | cut -d' ' -f1)
+if test $ncmp -gt 100; then
+  echo >&2 "Too many comparisons: $ncmp"
+  exit 1
+fi
+
+echo SUCCESS
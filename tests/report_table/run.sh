@@ -0,0 +1,53 @@
+#!/bin/sh
+
+# The MIT License (MIT)
+# 
+# Copyright (c) 2024 Yury Gribov
+# 
+# Use of this source code is governed by The MIT License (MIT)
+# that can be found in the LICENSE.txt file.
+
+# Check that SORTCHECK_REPORT_TABLE deduplicates errors across processes.
+
+set -eu
+#set -x
+
+cd $(dirname $0)
+
+ROOT=$PWD/../..
+PATH=$ROOT/scripts:$PATH
+
+CXXFLAGS='-Wall -Wextra -Werror -g'
+
+c++ repro.cpp $CXXFLAGS
+
+export SORTCHECK_ABORT=0
+export SORTCHECK_EXIT_CODE=0
+export SORTCHECK_REPORT_TABLE=table.bin
+export SORTCHECK_OUTPUT=out.log
+
+rm -f $SORTCHECK_REPORT_TABLE $SORTCHECK_OUTPUT
+
+for i in 1 2 3 4; do
+  ./a.out &
+done
+wait
+
+# Processes may report errors in any order
+sort $SORTCHECK_OUTPUT > test.log
+if ! diff -q repro.ref test.log; then
+  echo >&2 'Test did not produce expected output:'
+  diff repro.ref test.log >&2
+  exit 1
+fi
+
+$ROOT/bin/sortcheck-dump $SORTCHECK_REPORT_TABLE > dump.log
+if ! diff -q dump.ref dump.log; then
+  echo >&2 'Unexpected contents of report table:'
+  diff dump.ref dump.log >&2
+  exit 1
+fi
+
+rm -f $SORTCHECK_REPORT_TABLE $SORTCHECK_OUTPUT
+
+echo SUCCESS
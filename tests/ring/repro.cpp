@@ -0,0 +1,25 @@
+// Copyright 2024 Yury Gribov
+// 
+// Use of this source code is governed by MIT license that can be
+// found in the LICENSE.txt file.
+
+#include <algorithm>
+#include <vector>
+
+struct Compare {
+  bool operator()(int a, int b) const {
+    if (a == 7)
+      return true;
+    return a < b;
+  }
+};
+
+int main() {
+  for (int i = 0; i < 3; ++i) {
+    std::vector<int> v;
+    for (int j = 0; j < 40; ++j)
+      v.push_back(j);
+    std::stable_sort(v.begin(), v.end(), Compare());
+  }
+  return 0;
+}
@@ -0,0 +1,66 @@
+#!/bin/sh
+
+# The MIT License (MIT)
+# 
+# Copyright (c) 2024 Yury Gribov
+# 
+# Use of this source code is governed by The MIT License (MIT)
+# that can be found in the LICENSE.txt file.
+
+# Check that SORTCHECK_OUTPUT=ring:path and sortcheck-decode work.
+
+set -eu
+#set -x
+
+cd $(dirname $0)
+
+ROOT=$PWD/../..
+PATH=$ROOT/scripts:$PATH
+
+CXXFLAGS='-Wall -Wextra -Werror -g'
+
+c++ repro.cpp $CXXFLAGS
+
+export SORTCHECK_ABORT=0
+export SORTCHECK_EXIT_CODE=0
+
+SORTCHECK_OUTPUT=text.log ./a.out
+
+rm -f ring.bin
+SORTCHECK_OUTPUT=ring:ring.bin ./a.out > test.log 2>&1
+if test -s test.log; then
+  echo >&2 'Unexpected text output:'
+  cat test.log >&2
+  exit 1
+fi
+
+$ROOT/bin/sortcheck-decode ring.bin > decode.log
+if ! diff -q text.log decode.log; then
+  echo >&2 'Decoded records do not match text output:'
+  diff text.log decode.log >&2
+  exit 1
+fi
+
+$ROOT/bin/sortcheck-decode -t ring.bin > decode.log
+if ! grep -q '^[0-9-]* [0-9:.]* \[[0-9]*\] sortcheck: repro.cpp:22: ' decode.log; then
+  echo >&2 'Unexpected format of timestamped records:'
+  cat decode.log >&2
+  exit 1
+fi
+
+# Records of aborted process are preserved
+rm -f ring.bin
+if SORTCHECK_ABORT=1 SORTCHECK_OUTPUT=ring:ring.bin ./a.out > test.log 2>&1; then
+  echo >&2 'Test did not abort as expected'
+  exit 1
+fi
+$ROOT/bin/sortcheck-decode ring.bin > decode.log
+if ! head -1 text.log | diff -q - decode.log; then
+  echo >&2 'Unexpected records after abort:'
+  cat decode.log >&2
+  exit 1
+fi
+
+rm -f ring.bin text.log
+
+echo SUCCESS
@@ -0,0 +1,20 @@
+// Copyright 2024 Yury Gribov
+// 
+// Use of this source code is governed by MIT license that can be
+// found in the LICENSE.txt file.
+
+#include <algorithm>
+#include <vector>
+
+struct BadCompare {
+  bool operator()(int, int) {
+    return true;
+  }
+};
+
+int main() {
+  std::vector<int> v(1);
+  for (int i = 0; i < 10; ++i)
+    std::sort(v.begin(), v.end(), BadCompare());
+  return 0;
+}
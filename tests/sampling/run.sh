@@ -0,0 +1,59 @@
+#!/bin/sh
+
+# The MIT License (MIT)
+# 
+# Copyright (c) 2024 Yury Gribov
+# 
+# Use of this source code is governed by The MIT License (MIT)
+# that can be found in the LICENSE.txt file.
+
+# Check that SORTCHECK_SAMPLING works.
+
+set -eu
+#set -x
+
+cd $(dirname $0)
+
+ROOT=$PWD/../..
+PATH=$ROOT/scripts:$PATH
+
+CXXFLAGS='-Wall -Wextra -Werror -g'
+
+c++ repro.cpp $CXXFLAGS
+
+export SORTCHECK_ABORT=0
+export SORTCHECK_EXIT_CODE=0
+
+# All calls are checked by default
+./a.out > test.log 2>&1
+if test $(grep -c 'reflexive comparator' test.log) != 10; then
+  echo >&2 'Unexpected number of errors by default'
+  cat test.log >&2
+  exit 1
+fi
+
+# Check calls 0, 1, 2, 6
+SORTCHECK_SAMPLING=2,4 ./a.out > test.log 2>&1
+if ! diff -q repro.ref test.log; then
+  echo >&2 'Test did not produce expected output:'
+  diff repro.ref test.log >&2
+  exit 1
+fi
+
+# Check calls 0, 1, 2, 4, 8
+SORTCHECK_SAMPLING=1,1,4 ./a.out > test.log 2>&1
+if test $(grep -c 'reflexive comparator' test.log) != 5; then
+  echo >&2 'Backoff did not work'
+  cat test.log >&2
+  exit 1
+fi
+
+# Only first call is checked
+SORTCHECK_SAMPLING=1,0 ./a.out > test.log 2>&1
+if test $(grep -c 'reflexive comparator' test.log) != 1; then
+  echo >&2 'Unexpected number of errors with disabled sampling'
+  cat test.log >&2
+  exit 1
+fi
+
+echo SUCCESS
@@ -0,0 +1,42 @@
+// Copyright 2024 Yury Gribov
+// 
+// Use of this source code is governed by MIT license that can be
+// found in the LICENSE.txt file.
+
+#include <algorithm>
+#include <vector>
+
+#include <signal.h>
+#include <unistd.h>
+
+struct Compare {
+  bool operator()(int a, int b) const { return a < b; }
+};
+
+int main(int argc, char **argv) {
+  (void)argv;
+
+  std::vector<int> v;
+  for (int i = 0; i < 100; ++i)
+    v.push_back(100 - i);
+
+  for (int i = 0; i < 5; ++i) {
+    std::vector<int> tmp(v);
+    std::stable_sort(tmp.begin(), tmp.end(), Compare());
+  }
+
+  for (int i = 0; i < 3; ++i) {
+    std::vector<int> tmp(v);
+    std::stable_sort(tmp.begin(), tmp.end(), Compare());
+    if (!std::binary_search(tmp.begin(), tmp.end(), 50))
+      return 1;
+  }
+
+  // Dump statistics via signal and skip atexit handlers
+  if (argc > 1) {
+    raise(SIGUSR1);
+    _exit(0);
+  }
+
+  return 0;
+}
@@ -0,0 +1,63 @@
+#!/bin/sh
+
+# The MIT License (MIT)
+# 
+# Copyright (c) 2024 Yury Gribov
+# 
+# Use of this source code is governed by The MIT License (MIT)
+# that can be found in the LICENSE.txt file.
+
+# Check that SORTCHECK_STATS works.
+
+set -eu
+#set -x
+
+cd $(dirname $0)
+
+ROOT=$PWD/../..
+PATH=$ROOT/scripts:$PATH
+
+CXXFLAGS='-Wall -Wextra -Werror -g'
+
+c++ repro.cpp $CXXFLAGS
+
+export SORTCHECK_STATS=stats.json
+
+# Print all fields except timings (sites are sorted by line)
+summarize() {
+  python3 -c '
+import json, sys
+stats = json.load(open(sys.argv[1]))
+for s in sorted(stats["sites"], key=lambda s: s["line"]):
+  assert s["cycles"] > 0
+  print("%(file)s:%(line)d: calls %(calls)d, checks %(checks)d, elements %(elements)d, comparisons %(comparisons)d" % s)
+' $1
+}
+
+for mode in exit signal; do
+  rm -f $SORTCHECK_STATS
+  if test $mode = exit; then
+    ./a.out
+  else
+    SORTCHECK_STATS_SIGNAL=$(python3 -c 'import signal; print(int(signal.SIGUSR1))') ./a.out signal
+  fi
+  summarize $SORTCHECK_STATS > test.log
+  if ! diff -q repro.ref test.log; then
+    echo >&2 "Unexpected statistics on $mode:"
+    diff repro.ref test.log >&2
+    exit 1
+  fi
+done
+
+# Sampled calls are not checked
+SORTCHECK_SAMPLING=1,0 ./a.out
+summarize $SORTCHECK_STATS > test.log
+if ! grep -q 'calls 5, checks 1, elements 100,' test.log; then
+  echo >&2 'Unexpected statistics with sampling:'
+  cat test.log >&2
+  exit 1
+fi
+
+rm -f $SORTCHECK_STATS
+
+echo SUCCESS
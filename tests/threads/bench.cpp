@@ -0,0 +1,64 @@
+// Copyright 2024 Yury Gribov
+// 
+// Use of this source code is governed by MIT license that can be
+// found in the LICENSE.txt file.
+
+// Checks that cost of checks does not grow with number of threads
+// (e.g. due to contention on shared counters).
+
+#include <algorithm>
+#include <vector>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+struct Compare {
+  bool operator()(int a, int b) {
+    return a < b;
+  }
+};
+
+enum { ITERS = 1000000, MAX_THREADS = 8 };
+
+static void *run(void *) {
+  std::vector<int> v;
+  for (int j = 0; j < 8; ++j)
+    v.push_back(j);
+  int found = 0;
+  for (int i = 0; i < ITERS; ++i)
+    found += std::binary_search(v.begin(), v.end(), i & 7, Compare());
+  return found == ITERS ? 0 : (void *)1;
+}
+
+// Wall time of running ITERS calls in each of N threads
+static double measure(int n) {
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  pthread_t threads[MAX_THREADS];
+  for (int i = 0; i < n; ++i)
+    pthread_create(&threads[i], 0, run, 0);
+  for (int i = 0; i < n; ++i)
+    pthread_join(threads[i], 0);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+}
+
+int main(int argc, char *argv[]) {
+  const int n = argc > 1 ? atoi(argv[1]) : 4;
+  if (n < 1 || n > MAX_THREADS)
+    return 1;
+  // Best of several runs to reduce noise
+  double single = 1e9, multi = 1e9;
+  for (int i = 0; i < 3; ++i) {
+    single = std::min(single, measure(1));
+    multi = std::min(multi, measure(n));
+  }
+  // Ideally threads run in parallel and take as much time as one thread
+  const double ratio = multi / single;
+  if (ratio > 2) {
+    printf("%d threads are %g times slower than one\n", n, ratio);
+    return 1;
+  }
+  return 0;
+}
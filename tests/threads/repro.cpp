@@ -0,0 +1,34 @@
+// Copyright 2024 Yury Gribov
+// 
+// Use of this source code is governed by MIT license that can be
+// found in the LICENSE.txt file.
+
+#include <algorithm>
+#include <vector>
+#include <pthread.h>
+
+struct Compare {
+  bool operator()(int a, int b) {
+    return a < b;
+  }
+};
+
+static void *run(void *) {
+  for (int i = 0; i < 100; ++i) {
+    std::vector<int> v;
+    for (int j = 0; j < 100; ++j)
+      v.push_back(j * 37 % 101);
+    std::sort(v.begin(), v.end(), Compare());
+    std::binary_search(v.begin(), v.end(), i, Compare());
+  }
+  return 0;
+}
+
+int main() {
+  pthread_t threads[4];
+  for (int i = 0; i < 4; ++i)
+    pthread_create(&threads[i], 0, run, 0);
+  for (int i = 0; i < 4; ++i)
+    pthread_join(threads[i], 0);
+  return 0;
+}
@@ -0,0 +1,43 @@
+#!/bin/sh
+
+# The MIT License (MIT)
+# 
+# Copyright (c) 2024 Yury Gribov
+# 
+# Use of this source code is governed by The MIT License (MIT)
+# that can be found in the LICENSE.txt file.
+
+# Check that runtime has no data races and scales with number of threads.
+
+set -eu
+#set -x
+
+cd $(dirname $0)
+
+ROOT=$PWD/../..
+PATH=$ROOT/scripts:$PATH
+
+CXXFLAGS='-Wall -Wextra -Werror -g -pthread -fsanitize=thread'
+
+c++ repro.cpp $CXXFLAGS
+
+export TSAN_OPTIONS=halt_on_error=1
+
+if ! SORTCHECK_SHUFFLE=0 SORTCHECK_SAMPLING=4,4,64 ./a.out > test.log 2>&1; then
+  echo >&2 'Test failed:'
+  cat test.log >&2
+  exit 1
+fi
+
+# Scaling needs several CPUs (and no TSan)
+NCPU=$(nproc 2>/dev/null || echo 1)
+if test $NCPU -gt 1; then
+  c++ bench.cpp -Wall -Wextra -Werror -O2 -pthread
+  if ! ./a.out $((NCPU < 4 ? NCPU : 4)) > test.log 2>&1; then
+    echo >&2 'Checks do not scale with number of threads:'
+    cat test.log >&2
+    exit 1
+  fi
+fi
+
+echo SUCCESS
@@ -0,0 +1,23 @@
+// Copyright 2024 Yury Gribov
+// 
+// Use of this source code is governed by MIT license that can be
+// found in the LICENSE.txt file.
+
+#include <algorithm>
+#include <vector>
+
+// Non-strict comparison makes unguarded loops of std::sort
+// run out of range
+struct Compare {
+  bool operator()(int a, int b) const {
+    return a / 10 <= b / 10;
+  }
+};
+
+int main() {
+  std::vector<int> v;
+  for (int i = 0; i < 20; ++i)
+    v.push_back(i * 7 % 20);
+  std::sort(v.begin(), v.end(), Compare());
+  return 0;
+}
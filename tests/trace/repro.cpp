@@ -0,0 +1,27 @@
+// Copyright 2024 Yury Gribov
+// 
+// Use of this source code is governed by MIT license that can be
+// found in the LICENSE.txt file.
+
+#include <algorithm>
+#include <vector>
+#include <stdio.h>
+
+static unsigned ncmp;
+
+// Fuzzy comparison (non-transitive equivalence)
+struct Compare {
+  bool operator()(int a, int b) {
+    ++ncmp;
+    return a + 2 < b;
+  }
+};
+
+int main() {
+  std::vector<int> v;
+  for (int i = 0; i < 100; ++i)
+    v.push_back(i * 37 % 101);
+  std::sort(v.begin(), v.end(), Compare());
+  printf("%u comparisons\n", ncmp);
+  return 0;
+}
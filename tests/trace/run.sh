@@ -0,0 +1,65 @@
+#!/bin/sh
+
+# The MIT License (MIT)
+# 
+# Copyright (c) 2024 Yury Gribov
+# 
+# Use of this source code is governed by The MIT License (MIT)
+# that can be found in the LICENSE.txt file.
+
+# Check that SORTCHECK_TRACE works.
+
+set -eu
+#set -x
+
+cd $(dirname $0)
+
+ROOT=$PWD/../..
+PATH=$ROOT/scripts:$PATH
+
+CXXFLAGS='-Wall -Wextra -Werror -g'
+
+export SORTCHECK_ABORT=0
+export SORTCHECK_EXIT_CODE=0
+
+for std in c++98 c++11; do
+  c++ repro.cpp $CXXFLAGS -std=$std
+
+  # Number of comparisons in unchecked sort
+  SORTCHECK_SAMPLING=0,0 ./a.out > test.log 2>&1
+  ref=$(cat test.log)
+
+  SORTCHECK_TRACE=1 ./a.out > test.log 2>&1
+  if ! grep -q 'inconsistent comparator' test.log; then
+    echo >&2 'Tracing did not detect error'
+    cat test.log >&2
+    exit 1
+  fi
+  # Only small window is checked before sort
+  extra=$(($(tail -1 test.log | cut -d' ' -f1) - $(echo $ref | cut -d' ' -f1)))
+  if test $extra -lt 0 -o $extra -gt 64; then
+    echo >&2 "Tracing made $extra extra comparisons"
+    exit 1
+  fi
+done
+
+# Broken comparator does not make sort run out of range
+c++ nonstrict.cpp $CXXFLAGS -fsanitize=address
+SORTCHECK_TRACE=1 ./a.out > test.log 2>&1
+if grep -q AddressSanitizer test.log || ! grep -q 'reflexive comparator' test.log; then
+  echo >&2 'Unexpected output for non-strict comparator:'
+  cat test.log >&2
+  exit 1
+fi
+
+# Large ranges are checked as usual
+c++ large.cpp $CXXFLAGS
+SORTCHECK_SAMPLING=0,0 ./a.out > test.log 2>&1
+ref=$(cat test.log)
+SORTCHECK_TRACE=1 ./a.out > test.log 2>&1
+if test "$(tail -1 test.log)" = "$ref"; then
+  echo >&2 'Large range was traced'
+  exit 1
+fi
+
+echo SUCCESS
@@ -0,0 +1,42 @@
+#!/bin/sh
+
+# The MIT License (MIT)
+# 
+# Copyright (c) 2024 Yury Gribov
+# 
+# Use of this source code is governed by The MIT License (MIT)
+# that can be found in the LICENSE.txt file.
+
+# Check that -DSORTCHECK_USDT adds tracepoints.
+
+set -eu
+#set -x
+
+cd $(dirname $0)
+
+ROOT=$PWD/../..
+PATH=$ROOT/scripts:$PATH
+
+CXXFLAGS='-Wall -Wextra -Werror -g'
+
+if ! echo '#include <sys/sdt.h>' | c++ $CXXFLAGS ${SDT_CFLAGS:-} -E -x c++ - > /dev/null 2>&1; then
+  echo 'SUCCESS (skipped: <sys/sdt.h> not available)'
+  exit 0
+fi
+
+c++ repro.cpp $CXXFLAGS ${SDT_CFLAGS:-} -DSORTCHECK_USDT
+
+readelf -n a.out | sed -n 's/^ *Name: //p' | sort -u > test.log
+if ! diff -q repro.ref test.log; then
+  echo >&2 'Unexpected tracepoints:'
+  diff repro.ref test.log >&2
+  exit 1
+fi
+
+# Tracepoints do not change behavior
+if SORTCHECK_ABORT=0 ./a.out > /dev/null 2>&1; then
+  echo >&2 'Test did not fail as expected'
+  exit 1
+fi
+
+echo SUCCESS
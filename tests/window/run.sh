@@ -0,0 +1,48 @@
+#!/bin/sh
+
+# The MIT License (MIT)
+# 
+# Copyright (c) 2024 Yury Gribov
+# 
+# Use of this source code is governed by The MIT License (MIT)
+# that can be found in the LICENSE.txt file.
+
+# Check that SORTCHECK_WINDOW and SORTCHECK_WINDOW_MODE work.
+
+set -eu
+#set -x
+
+cd $(dirname $0)
+
+ROOT=$PWD/../..
+PATH=$ROOT/scripts:$PATH
+
+CXXFLAGS='-Wall -Wextra -Werror -g'
+
+c++ repro.cpp $CXXFLAGS
+
+export SORTCHECK_ABORT=0
+
+# Error is out of default window
+if ! ./a.out > test.log 2>&1; then
+  echo >&2 'Test unexpectedly failed'
+  cat test.log >&2
+  exit 1
+fi
+
+for opts in SORTCHECK_WINDOW=40 SORTCHECK_WINDOW=100 \
+            SORTCHECK_WINDOW_MODE=chunks \
+            'SORTCHECK_WINDOW=8 SORTCHECK_WINDOW_MODE=chunks' \
+            'SORTCHECK_WINDOW=8 SORTCHECK_WINDOW_MODE=stride'; do
+  if env $opts ./a.out > test.log 2>&1; then
+    echo >&2 "Test did not fail as expected with $opts"
+    exit 1
+  fi
+  if ! diff -q repro.ref test.log; then
+    echo >&2 "Test did not produce expected output with $opts:"
+    diff repro.ref test.log >&2
+    exit 1
+  fi
+done
+
+echo SUCCESS
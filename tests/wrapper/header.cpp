@@ -0,0 +1,8 @@
+#include <header/sort.h>
+#include <header/sort-twice.h>
+
+int main() {
+  std::vector<int> v(10);
+  sort(v);
+  return 0;
+}
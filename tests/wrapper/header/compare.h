@@ -0,0 +1,3 @@
+struct Compare {
+  bool operator()(int lhs, int rhs) const { return lhs < rhs; }
+};
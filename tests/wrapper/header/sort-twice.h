@@ -0,0 +1,4 @@
+#pragma once
+
+// Instrumented header is included again from header which is not instrumented
+#include "sort.h"
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "compare.h"
+
+inline void sort(std::vector<int> &v) {
+  std::sort(v.begin(), v.end(), Compare());
+}
@@ -27,4 +27,69 @@ cc example.cc -c -o example.cc.o
 cc example.cc.o
 ./a.out | grep -q 'Hello world'
 
+# Sources are instrumented out-of-tree
+c++ sort.cpp -MD
+./a.out
+if grep -q sortcheck sort.cpp; then
+  echo >&2 'Source file was modified'
+  exit 1
+fi
+if grep -q /sortcheck- *sort.d; then
+  echo >&2 'Dependency file refers to instrumented copy'
+  exit 1
+fi
+
+# Instrumented headers find their neighbours and are included only once
+c++ header.cpp -I.
+nm -C a.out | grep -q sortcheck
+
+# Results of instrumentation are cached
+SORTCHECK_CACHE_DIR=$PWD/cache
+export SORTCHECK_CACHE_DIR
+rm -rf $SORTCHECK_CACHE_DIR
+c++ sort.cpp
+c++ sort.cpp
+nm -C a.out | grep -q sortcheck
+c++ example.cc
+if test $(find $SORTCHECK_CACHE_DIR -mindepth 2 -maxdepth 2 | wc -l) != 2; then
+  echo >&2 'Unexpected number of cache entries'
+  exit 1
+fi
+rm -rf $SORTCHECK_CACHE_DIR
+unset SORTCHECK_CACHE_DIR
+
+# Instrumentation via server
+SORTCHECK_SERVER=$PWD/server.sock
+export SORTCHECK_SERVER
+rm -f $SORTCHECK_SERVER
+$ROOT/bin/SortChecker --server=$SORTCHECK_SERVER &
+SERVER_PID=$!
+trap "kill $SERVER_PID; rm -f $SORTCHECK_SERVER server.err" EXIT
+for i in $(seq 1 50); do
+  test -S $SORTCHECK_SERVER && break
+  sleep 0.1
+done
+c++ sort.cpp 2>server.err
+./a.out
+if grep -q warning server.err; then
+  cat >&2 server.err
+  exit 1
+fi
+
+# Malformed requests fail instead of hanging
+for req in '5\0/\0c++\0' '10\0/\0c++\03\0-v\0' 'x'; do
+  if ! timeout 5 python3 -c '
+import socket, sys
+s = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+s.connect(sys.argv[1])
+s.sendall(sys.argv[2].encode().decode("unicode_escape").encode())
+s.shutdown(socket.SHUT_WR)
+out, _, rc = s.recv(4096).rpartition(b"\0")
+sys.exit(b"malformed" not in out or rc in (b"", b"0"))
+' $SORTCHECK_SERVER "$req"; then
+    echo >&2 "Malformed request was not rejected: $req"
+    exit 1
+  fi
+done
+
 echo SUCCESS
@@ -0,0 +1,12 @@
+#include <algorithm>
+#include <vector>
+
+struct Compare {
+  bool operator()(int lhs, int rhs) const { return lhs < rhs; }
+};
+
+int main() {
+  std::vector<int> v(10);
+  std::sort(v.begin(), v.end(), Compare());
+  return 0;
+}